@@ -12,6 +12,15 @@ function Init(pBaseLuaWidget)
 	LuaPrint.print("BaseStruct1.m_JustEnum"..BaseStruct1.m_JustEnum);
 	--]]
 
+----[[ test struct member keeps its parent alive after the parent is collected
+	local MemberStruct = FBaseStruct1.New().m_Struct;
+	local MemberArray = FBaseStruct1.New().m_BaseStructs;
+	collectgarbage("collect");
+	MemberStruct.m = 12;
+	MemberArray:Add(MemberStruct);
+	LuaPrint.print("MemberStruct.m"..MemberStruct.m.." MemberArray:Get(0).m"..MemberArray:Get(0).m);
+	--]]
+
 --[[ test tmap 
 	local BaseStruct1 = FBaseStruct1.New();
 	local BaseStruct  = FBaseStruct.New();
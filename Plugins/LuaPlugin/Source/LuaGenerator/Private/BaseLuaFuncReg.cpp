@@ -357,19 +357,33 @@ FString FBaseFuncReg::GetRegLibContents()
 		}
 	}
 
+	bool bHasGetter = false;
+	bool bHasSetter = false;
 	for (const auto &Item : m_DataMembers)
 	{
 		const FExportDataMemberInfo &DataMember = Item.Value;
 		if (DataMember.VariableInfo.CanGenerateGetFunc && CanExportFunc(FString::Printf(TEXT("Get_%s"), *DataMember.VariableInfo.VariableName)))
 		{
 			RegLibContents += EndLinePrintf(TEXT("\t{ \"Get_%s\", %s },"), *DataMember.VariableInfo.VariableName, *GetLuaGetDataMemberName(DataMember.VariableInfo.VariableName));
+			bHasGetter = true;
 		}
 		if (DataMember.VariableInfo.CanGenerateSetFunc && CanExportFunc(FString::Printf(TEXT("Set_%s"), *DataMember.VariableInfo.VariableName)))
 		{
 			RegLibContents += EndLinePrintf(TEXT("\t{ \"Set_%s\", %s },"), *DataMember.VariableInfo.VariableName, *GetLuaSetDataMemberName(DataMember.VariableInfo.VariableName));
+			bHasSetter = true;
 		}
 	}
 
+	// batch access through the Getter/Setter libs below, one C call for many properties
+	if (bHasGetter && CanExportFunc(TEXT("GetMany")))
+	{
+		RegLibContents += EndLinePrintf(TEXT("\t{ \"GetMany\", FLuaUtil::GetManyFunc },"));
+	}
+	if (bHasSetter && CanExportFunc(TEXT("SetMany")))
+	{
+		RegLibContents += EndLinePrintf(TEXT("\t{ \"SetMany\", FLuaUtil::SetManyFunc },"));
+	}
+
 	for (const FExtraFuncMemberInfo &Item : m_ExtraFuncs)
 	{
 		if (CanExportFunc(*Item.funcName))
@@ -381,9 +395,51 @@ FString FBaseFuncReg::GetRegLibContents()
 	RegLibContents += EndLinePrintf(TEXT("\t{ NULL, NULL }"));
 	RegLibContents += EndLinePrintf(TEXT("};"));
 
+	RegLibContents += GetPropertyRegLibContents();
+
 	return RegLibContents;
 }
 
+FString FBaseFuncReg::GetPropertyRegLibContents()
+{ // property name -> Get_/Set_ function, used by __index and __newindex
+	FString GetterLibContents;
+	FString SetterLibContents;
+
+	GetterLibContents += EndLinePrintf(TEXT(""));
+	GetterLibContents += EndLinePrintf(TEXT("static const luaL_Reg %s_Getter_Lib[] ="), *m_ClassName);
+	GetterLibContents += EndLinePrintf(TEXT("{"));
+
+	SetterLibContents += EndLinePrintf(TEXT(""));
+	SetterLibContents += EndLinePrintf(TEXT("static const luaL_Reg %s_Setter_Lib[] ="), *m_ClassName);
+	SetterLibContents += EndLinePrintf(TEXT("{"));
+
+	for (const auto &Item : m_DataMembers)
+	{
+		const FVariableTypeInfo &VariableInfo = Item.Value.VariableInfo;
+		if (VariableInfo.ArrayDim > 1)
+		{ // multi dim members need an index, only reachable by Get_/Set_
+			continue;
+		}
+
+		if (VariableInfo.CanGenerateGetFunc && CanExportFunc(FString::Printf(TEXT("Get_%s"), *VariableInfo.VariableName)))
+		{
+			GetterLibContents += EndLinePrintf(TEXT("\t{ \"%s\", %s },"), *VariableInfo.VariableName, *GetLuaGetDataMemberName(VariableInfo.VariableName));
+		}
+		if (VariableInfo.CanGenerateSetFunc && CanExportFunc(FString::Printf(TEXT("Set_%s"), *VariableInfo.VariableName)))
+		{
+			SetterLibContents += EndLinePrintf(TEXT("\t{ \"%s\", %s },"), *VariableInfo.VariableName, *GetLuaSetDataMemberName(VariableInfo.VariableName));
+		}
+	}
+
+	GetterLibContents += EndLinePrintf(TEXT("\t{ NULL, NULL }"));
+	GetterLibContents += EndLinePrintf(TEXT("};"));
+
+	SetterLibContents += EndLinePrintf(TEXT("\t{ NULL, NULL }"));
+	SetterLibContents += EndLinePrintf(TEXT("};"));
+
+	return GetterLibContents + SetterLibContents;
+}
+
 FString FBaseFuncReg::GetFuncContents()
 {
 	FString Ret;
@@ -446,7 +502,7 @@ FString FBaseFuncReg::GetNomalFuncBody(const FExportFuncMemberInfo &FunctionItem
 
 	if (!FunctionItem.bStatic)
 	{ // touser pObject
-		FuncBody += EndLinePrintf(TEXT("\t%s *pObj = FLuaUtil::TouserData<%s*>(InLuaState, %d, \"%s\");"), *m_ClassName, *m_ClassName, luaStackIndex, *m_ClassName);
+		FuncBody += EndLinePrintf(TEXT("\t%s *pObj = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *m_ClassName, *m_ClassName, *m_ClassName);
 		++luaStackIndex;
 	}
 
@@ -486,33 +542,29 @@ FString FBaseFuncReg::GetNomalFuncBody(const FExportFuncMemberInfo &FunctionItem
 	else
 	{ // call the function with return
 		if (RetVarInfo.bNewReturn)
-		{
-			FuncBody += EndLinePrintf(TEXT("\t%s retVar = new %s();"), *RetVarInfo.DeclareType, *RetVarInfo.PureType);
-			FuncBody += EndLinePrintf(TEXT("\t%sretVar = %s;"), *RetVarInfo.UsedSelfVarPrefix, *CallFunc);
+		{ // returned by value, stored inside the userdata
+			FuncBody += EndLinePrintf(TEXT("\tFLuaUtil::Push(InLuaState, FLuaValueType<%s>(%s, \"%s\"));"), *RetVarInfo.OriginalType, *CallFunc, *RetVarInfo.TouserPushPureType);
 		}
-		else
+		else if (RetVarInfo.bNeedNewPushValue)
 		{
 			FuncBody += EndLinePrintf(TEXT("\t%s retVar = %s;"), *RetVarInfo.DeclareType, *CallFunc);
-		}
-
-		if (RetVarInfo.bNeedNewPushValue)
-		{
 			FuncBody += EndLinePrintf(TEXT("\t%s PushNewValue = %sretVar;"), *RetVarInfo.TouserPushDeclareType, *RetVarInfo.PushUsedSelfVarPrefix);
 			FuncBody += EndLinePrintf(TEXT("\tFLuaUtil::Push(InLuaState, FLuaClassType<%s>(PushNewValue, \"%s\"));"), *RetVarInfo.TouserPushDeclareType, *RetVarInfo.TouserPushPureType);
 		}
 		else
 		{
+			FuncBody += EndLinePrintf(TEXT("\t%s retVar = %s;"), *RetVarInfo.DeclareType, *CallFunc);
 			FuncBody += EndLinePrintf(TEXT("\tFLuaUtil::Push(InLuaState, FLuaClassType<%s>(retVar, \"%s\"));"), *RetVarInfo.TouserPushDeclareType, *RetVarInfo.TouserPushPureType);
 		}
 	}
 
-	if (RetVarInfo.bNewReturn)
+	if (RetVarInfo.OriginalType == "void")
 	{
-		FuncBody += EndLinePrintf(TEXT("\treturn 1;"));
+		FuncBody += EndLinePrintf(TEXT("\treturn 0;"));
 	}
 	else
 	{
-		FuncBody += EndLinePrintf(TEXT("\treturn 0;"));
+		FuncBody += EndLinePrintf(TEXT("\treturn 1;"));
 	}
 
 	return FuncBody;
@@ -524,6 +576,12 @@ FString FBaseFuncReg::GetMinmialAPIFuncBody(const FExportFuncMemberInfo &Functio
 	int32 LuaStackIndex = 1;
 	const FVariableTypeInfo &RetVarInfo = FunctionItem.ReturnType;
 
+	if (!FunctionItem.bStatic)
+	{ // before args, a released self raises a lua error that would skip its destructor
+		FuncBody += EndLinePrintf(TEXT("\t%s *pObj = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *m_ClassName, *m_ClassName, *m_ClassName);
+		++LuaStackIndex;
+	}
+
 	// declare params
 	FuncBody += EndLinePrintf(TEXT("\tstruct params"));
 	FuncBody += EndLinePrintf(TEXT("\t{"));
@@ -537,19 +595,14 @@ FString FBaseFuncReg::GetMinmialAPIFuncBody(const FExportFuncMemberInfo &Functio
 	}
 	FuncBody += EndLinePrintf(TEXT("\t}args;"));
 
-	if (!FunctionItem.bStatic)
-	{
-		FuncBody += EndLinePrintf(TEXT("\t%s *pObj = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *m_ClassName, *m_ClassName, *m_ClassName);
-		++LuaStackIndex;
-	}
-	
 	for (const FVariableTypeInfo &VarInfo : FunctionItem.FunctionParams)
-	{
-		FuncBody += EndLinePrintf(TEXT("\targs.%s = %s%sFLuaUtil::TouserData<%s>(InLuaState, 1, \"%s\");"), *VarInfo.VariableName, *VarInfo.UsedSelfVarPrefix, *VarInfo.CastType, *VarInfo.TouserPushDeclareType, *VarInfo.TouserPushPureType );
+	{ // params follow self on the stack, each one read from its own index
+		FuncBody += EndLinePrintf(TEXT("\targs.%s = %s%sFLuaUtil::TouserData<%s>(InLuaState, %d, \"%s\");"), *VarInfo.VariableName, *VarInfo.UsedSelfVarPrefix, *VarInfo.CastType, *VarInfo.TouserPushDeclareType, LuaStackIndex, *VarInfo.TouserPushPureType );
 		++LuaStackIndex;
 	}
 
-	FuncBody += EndLinePrintf(TEXT("\tUFunction *Func = %s::StaticClass()->FindFunctionByName(FName(\"%s\"));"), *m_ClassName, *FunctionItem.FunctionName);
+	// resolved on the first call only
+	FuncBody += EndLinePrintf(TEXT("\tstatic UFunction *Func = %s::StaticClass()->FindFunctionByName(FName(\"%s\"));"), *m_ClassName, *FunctionItem.FunctionName);
 	if (FunctionItem.bStatic)
 	{
 		FuncBody += EndLinePrintf(TEXT("\tGetMutableDefault<%s>()->ProcessEvent(Func, &args);"), *m_ClassName);
@@ -562,18 +615,8 @@ FString FBaseFuncReg::GetMinmialAPIFuncBody(const FExportFuncMemberInfo &Functio
 	if (RetVarInfo.bNeedReturn)
 	{
 		if (RetVarInfo.bNewReturn)
-		{
-			FuncBody += EndLinePrintf(TEXT("\t%s NewRetValue = new %s();"), *RetVarInfo.DeclareType, *RetVarInfo.PureType);
-			FuncBody += EndLinePrintf(TEXT("\t%sNewRetValue = args.%s;"), *RetVarInfo.UsedSelfVarPrefix, *RetVarInfo.VariableName);
-			if (RetVarInfo.bNeedNewPushValue)
-			{
-				FuncBody += EndLinePrintf(TEXT("\t%s NewPushValue = %sNewRetValue;"), *RetVarInfo.TouserPushDeclareType, *RetVarInfo.PushUsedSelfVarPrefix);
-				FuncBody += EndLinePrintf(TEXT("\tFLuaUtil::Push(InLuaState, FLuaClassType<%s>(NewRetValue, \"%s\"));"), *RetVarInfo.TouserPushDeclareType, *RetVarInfo.TouserPushPureType);
-			}
-			else
-			{
-				FuncBody += EndLinePrintf(TEXT("\tFLuaUtil::Push(InLuaState, FLuaClassType<%s>(NewRetValue, \"%s\"));"), *RetVarInfo.TouserPushDeclareType, *RetVarInfo.TouserPushPureType);
-			}
+		{ // args is dead after the call, move the return value into the userdata
+			FuncBody += EndLinePrintf(TEXT("\tFLuaUtil::Push(InLuaState, FLuaValueType<%s>(MoveTemp(args.%s), \"%s\"));"), *RetVarInfo.OriginalType, *RetVarInfo.VariableName, *RetVarInfo.TouserPushPureType);
 		}
 		else
 		{
@@ -624,7 +667,7 @@ FString FBaseFuncReg::GetLuaGetDataMemberFuncContent(const FExportDataMemberInfo
 	
 	if (VariableInfo.bSupportNow)
 	{
-		RetContents += EndLinePrintf(TEXT("\t%s *pObj = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *m_ClassName, *m_ClassName, *m_ClassName);
+		RetContents += EndLinePrintf(TEXT("\t%s *pObj = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *m_ClassName, *m_ClassName, *m_ClassName);
 		if (VariableInfo.bNeedNewPushValue)
 		{
 			RetContents += EndLinePrintf(TEXT("\t%s memberVariable1 = (%s)%spObj->%s;"), *VariableInfo.DeclareType, *VariableInfo.DeclareType, *VariableInfo.AssignValuePrefix, *VariableInfo.VariableName);
@@ -635,6 +678,10 @@ FString FBaseFuncReg::GetLuaGetDataMemberFuncContent(const FExportDataMemberInfo
 			RetContents += EndLinePrintf(TEXT("\t%s memberVariable = (%s)%spObj->%s;"), *VariableInfo.DeclareType, *VariableInfo.DeclareType, *VariableInfo.AssignValuePrefix, *VariableInfo.VariableName);
 		}
 		RetContents += EndLinePrintf(TEXT("\tFLuaUtil::Push(InLuaState, FLuaClassType<%s>(memberVariable, \"%s\"));"), *VariableInfo.TouserPushDeclareType, *VariableInfo.TouserPushPureType);
+		if (VariableInfo.AssignValuePrefix == "&")
+		{ // the member lives inside pObj, which may be freed by __gc
+			RetContents += EndLinePrintf(TEXT("\tFLuaUtil::SetOwner(InLuaState, -1, 1);"));
+		}
 	}
 	else
 	{
@@ -659,7 +706,7 @@ FString FBaseFuncReg::GetLuaSetDataMemberFuncContent(const FExportDataMemberInfo
 
 	if (VariableInfo.bSupportNow)
 	{
-		RetContents += EndLinePrintf(TEXT("\t%s *pObj = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *m_ClassName, *m_ClassName, *m_ClassName);
+		RetContents += EndLinePrintf(TEXT("\t%s *pObj = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *m_ClassName, *m_ClassName, *m_ClassName);
 		RetContents += EndLinePrintf(TEXT("\t%s NewValue = %sFLuaUtil::TouserData<%s>(InLuaState, 2, \"%s\");"), *VariableInfo.DeclareType, *VariableInfo.CastType, *VariableInfo.TouserPushDeclareType, *VariableInfo.TouserPushPureType);
 		RetContents += EndLinePrintf(TEXT("\tpObj->%s = %sNewValue;"), *VariableInfo.VariableName, *VariableInfo.UsedSelfVarPrefix);
 	}
@@ -685,7 +732,7 @@ FString FBaseFuncReg::GetLuaGetMutilDimDataMemberFuncContent(const FExportDataMe
 
 	if (VariableInfo.bSupportNow)
 	{
-		RetContents += EndLinePrintf(TEXT("\t%s *pObj = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *m_ClassName, *m_ClassName, *m_ClassName);
+		RetContents += EndLinePrintf(TEXT("\t%s *pObj = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *m_ClassName, *m_ClassName, *m_ClassName);
 		RetContents += EndLinePrintf(TEXT("\tint32 Index = FLuaUtil::TouserData<int32>(InLuaState, 2, \"int32\");"));
 		if (VariableInfo.bNeedNewPushValue)
 		{
@@ -697,6 +744,10 @@ FString FBaseFuncReg::GetLuaGetMutilDimDataMemberFuncContent(const FExportDataMe
 			RetContents += EndLinePrintf(TEXT("\t%s memberVariable = (%s)%s(pObj->%s[Index]);"), *VariableInfo.DeclareType, *VariableInfo.DeclareType, *VariableInfo.AssignValuePrefix, *VariableInfo.VariableName);
 		}
 		RetContents += EndLinePrintf(TEXT("\tFLuaUtil::Push(InLuaState, FLuaClassType<%s>(memberVariable, \"%s\"));"), *VariableInfo.TouserPushDeclareType, *VariableInfo.TouserPushPureType);
+		if (VariableInfo.AssignValuePrefix == "&")
+		{ // the member lives inside pObj, which may be freed by __gc
+			RetContents += EndLinePrintf(TEXT("\tFLuaUtil::SetOwner(InLuaState, -1, 1);"));
+		}
 	}
 	else
 	{
@@ -721,7 +772,7 @@ FString FBaseFuncReg::GetLuaSetMutilDimDataMemberFuncContent(const FExportDataMe
 
 	if (VariableInfo.bSupportNow)
 	{
-		RetContents += EndLinePrintf(TEXT("\t%s *pObj = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *m_ClassName, *m_ClassName, *m_ClassName);
+		RetContents += EndLinePrintf(TEXT("\t%s *pObj = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *m_ClassName, *m_ClassName, *m_ClassName);
 		RetContents += EndLinePrintf(TEXT("\tint32 Index = FLuaUtil::TouserData<int32>(InLuaState, 2, \"int32\");"));
 		RetContents += EndLinePrintf(TEXT("\t%s NewValue = %sFLuaUtil::TouserData<%s>(InLuaState, 3, \"%s\");"), *VariableInfo.DeclareType, *VariableInfo.CastType, *VariableInfo.TouserPushDeclareType, *VariableInfo.TouserPushPureType);
 		RetContents += EndLinePrintf(TEXT("\tpObj->%s[Index] = %sNewValue;"), *VariableInfo.VariableName, *VariableInfo.UsedSelfVarPrefix);
@@ -6,8 +6,7 @@
 using namespace NS_LuaGenerator;
 
 FClassParentManager::FClassParentManager()
-	: m_ParentClassMatrix(nullptr)
-	, m_ClassNum(0)
+	: m_ClassNum(0)
 	, m_FirstAvailableIndex(0)
 {
 
@@ -29,10 +28,9 @@ void FClassParentManager::Init(const TArray<IScriptGenerator*> &ClassGenerators)
 	}
 
 	m_ClassNum = ClassNum;
-	CreateParentMatrix();
-	InitParentMatrix(ClassGenerators);
-	InitParentIndex();
-	DestoryParentMatrix();
+	InitDirectParents(ClassGenerators);
+	InitAncestors();
+	InitClassIds();
 }
 
 TArray<FString> FClassParentManager::GetParentClassNames(const FString &ClassName)
@@ -41,8 +39,9 @@ TArray<FString> FClassParentManager::GetParentClassNames(const FString &ClassNam
 	int32 *pIndex = m_ClassName2Index.Find(ClassName);
 	if (pIndex)
 	{
-		for ( int32 ParentIndex : m_ParentIndexs[*pIndex])
+		for (int32 i = m_AncestorStarts[*pIndex]; i < m_AncestorStarts[*pIndex + 1]; ++i)
 		{
+			int32 ParentIndex = m_AncestorIndexs[i];
 			FString *pClasName = m_Index2ClassName.Find(ParentIndex);
 
 			if (pClasName)
@@ -63,6 +62,20 @@ TArray<FString> FClassParentManager::GetParentClassNames(const FString &ClassNam
 	return ParentNames;
 }
 
+bool FClassParentManager::GetClassIdRange(const FString &ClassName, int32 &OutClassId, int32 &OutClassIdEnd) const
+{
+	const int32 *pIndex = m_ClassName2Index.Find(ClassName);
+	if (pIndex == nullptr || !m_ClassIds.IsValidIndex(*pIndex))
+	{
+		UE_LOG(LogLuaGenerator, Error, TEXT("GetClassIdRange error, not find class:%s"), *ClassName);
+		return false;
+	}
+
+	OutClassId = m_ClassIds[*pIndex];
+	OutClassIdEnd = m_ClassIdEnds[*pIndex];
+	return true;
+}
+
 int32 FClassParentManager::GetClassIndex(const FString &InClassName)
 {
 	int32 *pIndex = m_ClassName2Index.Find(InClassName);
@@ -87,71 +100,165 @@ int32 FClassParentManager::GetClassIndex(const FString &InClassName)
 	}
 }
 
-void FClassParentManager::InitParentIndex()
+void FClassParentManager::InitDirectParents(const TArray<IScriptGenerator*> &ClassGenerators)
 {
-	for (int32 ClassIndex=0; ClassIndex<m_ClassNum; ++ClassIndex)
+	m_PrimaryParentIndexs.Init(-1, m_ClassNum);
+	m_DirectParentIndexs.Empty(m_ClassNum);
+	m_DirectParentIndexs.SetNum(m_ClassNum);
+
+	for (IScriptGenerator *const pGenerator : ClassGenerators)
 	{
-		TArray<int32> ParentIndexs;
-		for (int32 ParentIndex=0; ParentIndex<m_ClassNum; ++ParentIndex)
+		FString GeneratorClassName = pGenerator->GetKey();
+		int32 GeneratorIndex = GetClassIndex(GeneratorClassName);
+		TArray<FString> ParentNames;
+		pGenerator->GetParentNames(ParentNames);
+
+		for (const FString &ParentName : ParentNames)
 		{
-			if (m_ParentClassMatrix[ClassIndex][ParentIndex])
+			int32 ParentIndex = GetClassIndex(ParentName);
+			if (GeneratorIndex >= 0 && ParentIndex >= 0)
 			{
-				ParentIndexs.Add(ParentIndex);
+				m_DirectParentIndexs[GeneratorIndex].AddUnique(ParentIndex);
 			}
 		}
-		m_ParentIndexs.Add(ParentIndexs);
+
+		// the class id tree follows the reflected supers, not the config inheritance above
+		FString TypeParentName = pGenerator->GetTypeParentName();
+		if (!TypeParentName.IsEmpty() && GeneratorIndex >= 0)
+		{
+			m_PrimaryParentIndexs[GeneratorIndex] = GetClassIndex(TypeParentName);
+		}
+
+		if (ParentNames.Num() > 1)
+		{
+			UE_LOG(LogLuaGenerator, Warning, TEXT("class:%s has more than one parent, only %s is used for the userdata type check"), *GeneratorClassName, *TypeParentName);
+		}
 	}
 }
 
-void FClassParentManager::CreateParentMatrix()
-{
-	m_ParentClassMatrix = new bool *[m_ClassNum];
-	for (int32 i = 0; i < m_ClassNum; ++i)
+void FClassParentManager::InitAncestors()
+{ // memoized dfs over the direct parents, O(classes * depth) instead of a transitive closure over a classes^2 matrix
+	TArray<TArray<int32>> Ancestors;
+	Ancestors.SetNum(m_ClassNum);
+	TArray<uint8> VisitStates; // 0 not visited, 1 on the dfs path, 2 done
+	VisitStates.Init(0, m_ClassNum);
+
+	for (int32 ClassIndex = 0; ClassIndex < m_ClassNum; ++ClassIndex)
+	{
+		CollectAncestors(ClassIndex, Ancestors, VisitStates);
+	}
+
+	// flatten, the ancestors of a class are m_AncestorIndexs[m_AncestorStarts[Index], m_AncestorStarts[Index + 1])
+	int32 AncestorNum = 0;
+	for (const TArray<int32> &ClassAncestors : Ancestors)
+	{
+		AncestorNum += ClassAncestors.Num();
+	}
+
+	m_AncestorStarts.Empty(m_ClassNum + 1);
+	m_AncestorIndexs.Empty(AncestorNum);
+	for (const TArray<int32> &ClassAncestors : Ancestors)
+	{
+		m_AncestorStarts.Add(m_AncestorIndexs.Num());
+		m_AncestorIndexs.Append(ClassAncestors);
+	}
+	m_AncestorStarts.Add(m_AncestorIndexs.Num());
+	m_DirectParentIndexs.Empty();
+}
+
+void FClassParentManager::CollectAncestors(int32 ClassIndex, TArray<TArray<int32>> &Ancestors, TArray<uint8> &VisitStates)
+{ // nearest parents first, the order GetParentClassNames hands out
+	if (VisitStates[ClassIndex] == 2)
 	{
-		m_ParentClassMatrix[i] = new bool[m_ClassNum];
+		return;
+	}
+
+	if (VisitStates[ClassIndex] == 1)
+	{
+		UE_LOG(LogLuaGenerator, Error, TEXT("FClassParentManager::CollectAncestors class:%s is in a parent cycle"), *m_Index2ClassName.FindRef(ClassIndex));
+		return;
+	}
+
+	VisitStates[ClassIndex] = 1;
+	TArray<int32> ClassAncestors;
+	for (int32 ParentIndex : m_DirectParentIndexs[ClassIndex])
+	{
+		ClassAncestors.AddUnique(ParentIndex);
+	}
 
-		for (int32 j = 0; j < m_ClassNum; ++j)
+	for (int32 ParentIndex : m_DirectParentIndexs[ClassIndex])
+	{
+		CollectAncestors(ParentIndex, Ancestors, VisitStates);
+		for (int32 AncestorIndex : Ancestors[ParentIndex])
 		{
-			m_ParentClassMatrix[i][j] = false;
+			if (AncestorIndex != ClassIndex)
+			{
+				ClassAncestors.AddUnique(AncestorIndex);
+			}
 		}
 	}
+
+	Ancestors[ClassIndex] = MoveTemp(ClassAncestors);
+	VisitStates[ClassIndex] = 2;
 }
 
-void FClassParentManager::InitParentMatrix(const TArray<IScriptGenerator*> &ClassGenerators)
-{
-	for (IScriptGenerator *const pGenerator : ClassGenerators)
+void FClassParentManager::InitClassIds()
+{ // preorder numbering of the primary parent tree, a class and all its children get the contiguous range [ClassId, ClassIdEnd)
+	TArray<TArray<int32>> ChildIndexs;
+	ChildIndexs.SetNum(m_ClassNum);
+	for (int32 ClassIndex = 0; ClassIndex < m_ClassNum; ++ClassIndex)
 	{
-		FString GeneratorClassName = pGenerator->GetKey();
-		int32 GeneratorIndex = GetClassIndex(GeneratorClassName);
-		TArray<FString> ParentNames;
-		pGenerator->GetParentNames(ParentNames);
-
-		for (const FString &ParentName : ParentNames)
+		int32 ParentIndex = m_PrimaryParentIndexs[ClassIndex];
+		if (ParentIndex >= 0 && ParentIndex != ClassIndex)
 		{
-			int32 ParentIndex = GetClassIndex(ParentName);
-			m_ParentClassMatrix[GeneratorIndex][ParentIndex] = true;
+			ChildIndexs[ParentIndex].Add(ClassIndex);
 		}
 	}
 
-	// flody algorithm, cal is reachable
-	for (int32 k=0; k<m_ClassNum; ++k)
+	m_ClassIds.Init(-1, m_ClassNum);
+	m_ClassIdEnds.Init(-1, m_ClassNum);
+	int32 NextClassId = 0;
+	TArray<TPair<int32, int32>> Stack; // class index, next child to visit
+
+	for (int32 RootIndex = 0; RootIndex < m_ClassNum; ++RootIndex)
 	{
-		for (int32 i=0; i<m_ClassNum; ++i)
+		int32 ParentIndex = m_PrimaryParentIndexs[RootIndex];
+		bool bRoot = ParentIndex < 0 || ParentIndex == RootIndex;
+		if (!bRoot || m_ClassIds[RootIndex] >= 0)
+		{
+			continue;
+		}
+
+		m_ClassIds[RootIndex] = NextClassId++;
+		Stack.Add(TPair<int32, int32>(RootIndex, 0));
+		while (Stack.Num() > 0)
 		{
-			for (int32 j=0; j<m_ClassNum; ++j)
+			TPair<int32, int32> &Top = Stack.Last();
+			const TArray<int32> &Children = ChildIndexs[Top.Key];
+			if (Top.Value < Children.Num())
+			{
+				int32 ChildIndex = Children[Top.Value++];
+				if (m_ClassIds[ChildIndex] < 0)
+				{
+					m_ClassIds[ChildIndex] = NextClassId++;
+					Stack.Add(TPair<int32, int32>(ChildIndex, 0));
+				}
+			}
+			else
 			{
-				m_ParentClassMatrix[i][j] = m_ParentClassMatrix[i][j] || (m_ParentClassMatrix[i][k] && m_ParentClassMatrix[k][j]);
+				m_ClassIdEnds[Top.Key] = NextClassId;
+				Stack.Pop(false);
 			}
 		}
 	}
-}
 
-void FClassParentManager::DestoryParentMatrix()
-{
-	for (int32 i = 0; i < m_ClassNum; ++i)
+	for (int32 ClassIndex = 0; ClassIndex < m_ClassNum; ++ClassIndex)
 	{
-		delete []m_ParentClassMatrix[i];
+		if (m_ClassIds[ClassIndex] < 0)
+		{ // parent cycle, the class only matches itself
+			UE_LOG(LogLuaGenerator, Error, TEXT("FClassParentManager::InitClassIds class:%s is in a parent cycle"), *m_Index2ClassName.FindRef(ClassIndex));
+			m_ClassIds[ClassIndex] = NextClassId++;
+			m_ClassIdEnds[ClassIndex] = NextClassId;
+		}
 	}
-
-	delete[]m_ParentClassMatrix;
 }
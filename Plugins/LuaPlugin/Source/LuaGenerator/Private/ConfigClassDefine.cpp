@@ -253,6 +253,28 @@ FString FConfigClass::GetRegLibChunk()
 	Ret += EndLinePrintf(TEXT("\t{ NULL, NULL }"));
 	Ret += EndLinePrintf(TEXT("};"));
 
+	// property getter reg
+	Ret += EndLinePrintf(TEXT(""));
+	Ret += EndLinePrintf(TEXT("static const luaL_Reg %s_Getter_Lib[] ="), *ClassName);
+	Ret += EndLinePrintf(TEXT("{"));
+	for (const FConfigVariable& ConfigVariableItem : Variables)
+	{
+		Ret += EndLinePrintf(TEXT("\t{ \"%s\", %s_Get_%s },"), *ConfigVariableItem.VariableName, *ClassName, *ConfigVariableItem.VariableName);
+	}
+	Ret += EndLinePrintf(TEXT("\t{ NULL, NULL }"));
+	Ret += EndLinePrintf(TEXT("};"));
+
+	// property setter reg
+	Ret += EndLinePrintf(TEXT(""));
+	Ret += EndLinePrintf(TEXT("static const luaL_Reg %s_Setter_Lib[] ="), *ClassName);
+	Ret += EndLinePrintf(TEXT("{"));
+	for (const FConfigVariable& ConfigVariableItem : Variables)
+	{
+		Ret += EndLinePrintf(TEXT("\t{ \"%s\", %s_Set_%s },"), *ConfigVariableItem.VariableName, *ClassName, *ConfigVariableItem.VariableName);
+	}
+	Ret += EndLinePrintf(TEXT("\t{ NULL, NULL }"));
+	Ret += EndLinePrintf(TEXT("};"));
+
 	return Ret;
 }
 
@@ -423,7 +445,7 @@ FString FConfigFunction::GetFunctionBodyChunk(const FConfigClass &ConfigClass) c
 
 	if (bStatic==false)
 	{
-		Ret += EndLinePrintf(TEXT("\t%s *pObj = FLuaUtil::TouserData<%s*>(InLuaState, %d, \"%s\");"), *ConfigClass.GetClassName(), *ConfigClass.GetClassName(), luaStackIndex, *ConfigClass.GetClassName());
+		Ret += EndLinePrintf(TEXT("\t%s *pObj = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *ConfigClass.GetClassName(), *ConfigClass.GetClassName(), *ConfigClass.GetClassName());
 		++luaStackIndex;
 	}
 
@@ -648,7 +670,7 @@ FString FConfigVariable::GenerateGetVariableTrunck(const FString &ClassName)cons
 	}
 	else
 	{
-		Ret += EndLinePrintf(TEXT("\t%s *pObj = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *ClassName, *ClassName, *ClassName);
+		Ret += EndLinePrintf(TEXT("\t%s *pObj = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *ClassName, *ClassName, *ClassName);
 		Ret += EndLinePrintf(TEXT("\t%s memberVariable = pObj->%s;"), *VariableType, *VariableName);
 	}
 
@@ -668,7 +690,7 @@ FString FConfigVariable::GenerateSetVariableTrunck(const FString &ClassName)cons
 
 	if (!bStatic)
 	{
-		Ret += EndLinePrintf(TEXT("\t%s *pObj = FLuaUtil::TouserData<%s*>(InLuaState, %d, \"%s\");"), *ClassName, *ClassName, luaStackIndex, *ClassName);
+		Ret += EndLinePrintf(TEXT("\t%s *pObj = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *ClassName, *ClassName, *ClassName);
 		++luaStackIndex;
 	}
 
@@ -43,7 +43,7 @@ void FConfigClassGenerator::SaveToFile()
 	FString fileName = m_OutDir/ GetFileName();
 	FString fileContent;
 	Unity(fileContent);
-	if (!FFileHelper::SaveStringToFile(fileContent, *fileName))
+	if (!SaveFileContent(fileContent, fileName))
 	{
 		UE_LOG(LogLuaGenerator, Error, TEXT("Failed to save header export:%s"), *fileName);
 	}
@@ -5,6 +5,7 @@
 IScriptGenerator::IScriptGenerator(NS_LuaGenerator::E_GeneratorType InType, const FString &OutDir)
 	: m_eClassType(InType)
 	, m_OutDir(OutDir)
+	, m_ContentHash(0)
 {
 
 }
@@ -24,11 +25,28 @@ FString IScriptGenerator::GetRegName() const
 	return FString::Printf(TEXT("%s_Lib"), *GetClassName());
 }
 
+FString IScriptGenerator::GetPropertyGetterRegName() const
+{
+	return FString::Printf(TEXT("%s_Getter_Lib"), *GetClassName());
+}
+
+FString IScriptGenerator::GetPropertySetterRegName() const
+{
+	return FString::Printf(TEXT("%s_Setter_Lib"), *GetClassName());
+}
+
 void IScriptGenerator::GetParentNames(TArray<FString> &OutParentNames) const
 {
 
 }
 
+FString IScriptGenerator::GetTypeParentName() const
+{ // config classes have no reflected super, their first config parent stands in
+	TArray<FString> ParentNames;
+	GetParentNames(ParentNames);
+	return ParentNames.Num() > 0 ? ParentNames[0] : FString();
+}
+
 FString IScriptGenerator::GetFileHeader()
 {
 	FString StrContent;
@@ -45,3 +63,8 @@ FString IScriptGenerator::GetFileTail()
 	return StrContent;
 }
 
+bool IScriptGenerator::SaveFileContent(const FString &FileContent, const FString &FilePathName)
+{ // the hash tells the next incremental export whether classes depending on this one need regenerating
+	m_ContentHash = FCrc::StrCrc32(*FileContent);
+	return NS_LuaGenerator::SaveFileIfChanged(FileContent, FilePathName);
+}
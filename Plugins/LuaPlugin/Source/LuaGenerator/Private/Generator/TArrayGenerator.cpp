@@ -51,7 +51,7 @@ void FTArrayGenerator::SaveToFile()
 	FileContent += m_LuaFuncReg.GetRegLibContents();
 	FileContent += GetFileTail();
 
-	if (!FFileHelper::SaveStringToFile(FileContent, *FilePathName))
+	if (!SaveFileContent(FileContent, FilePathName))
 	{
 		UE_LOG(LogLuaGenerator, Error, TEXT("Failed to save header export:%s"), *GetFileName());
 	}
@@ -67,7 +67,7 @@ FExtraFuncMemberInfo FTArrayGenerator::ExtraNum()
 	FExtraFuncMemberInfo ExtraInfo;
 	ExtraInfo.funcName = "Num";
 	FString &funcBody = ExtraInfo.funcBody;
-	funcBody += EndLinePrintf(TEXT("\t%s *pTArray = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *m_TArrayInfo.PureType, *m_TArrayInfo.PureType, *m_TArrayInfo.PureType);
+	funcBody += EndLinePrintf(TEXT("\t%s *pTArray = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *m_TArrayInfo.PureType, *m_TArrayInfo.PureType, *m_TArrayInfo.PureType);
 	funcBody += EndLinePrintf(TEXT("\tint32 ArrayNum = pTArray->Num();"));
 	funcBody += EndLinePrintf(TEXT("\tFLuaUtil::Push(InLuaState, FLuaClassType<int32>(ArrayNum, \"int32\"));"));
 	funcBody += EndLinePrintf(TEXT("\treturn 1;"));
@@ -79,7 +79,7 @@ FExtraFuncMemberInfo FTArrayGenerator::ExtraAdd()
 	FExtraFuncMemberInfo ExtraInfo;
 	ExtraInfo.funcName = "Add";
 	FString &funcBody = ExtraInfo.funcBody;
-	funcBody += EndLinePrintf(TEXT("\t%s *pTArray = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *m_TArrayInfo.PureType, *m_TArrayInfo.PureType, *m_TArrayInfo.PureType);
+	funcBody += EndLinePrintf(TEXT("\t%s *pTArray = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *m_TArrayInfo.PureType, *m_TArrayInfo.PureType, *m_TArrayInfo.PureType);
 	funcBody += EndLinePrintf(TEXT("\t%s ArrayItem = %sFLuaUtil::TouserData<%s>(InLuaState, 2, \"%s\");"), *m_ElementInfo.DeclareType, *m_ElementInfo.CastType, *m_ElementInfo.TouserPushDeclareType, *m_ElementInfo.TouserPushPureType);
 	funcBody += EndLinePrintf(TEXT("\tpTArray->Add(%sArrayItem);"), *m_ElementInfo.UsedSelfVarPrefix);
 	funcBody += EndLinePrintf(TEXT("\treturn 0;"));
@@ -91,7 +91,7 @@ FExtraFuncMemberInfo FTArrayGenerator::ExtraGet()
 	FExtraFuncMemberInfo ExtraInfo;
 	ExtraInfo.funcName = "Get";
 	FString &funcBody = ExtraInfo.funcBody;
-	funcBody += EndLinePrintf(TEXT("\t%s *pTArray = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *m_TArrayInfo.PureType, *m_TArrayInfo.PureType, *m_TArrayInfo.PureType);
+	funcBody += EndLinePrintf(TEXT("\t%s *pTArray = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *m_TArrayInfo.PureType, *m_TArrayInfo.PureType, *m_TArrayInfo.PureType);
 	funcBody += EndLinePrintf(TEXT("\tint32 ArrayIndex = FLuaUtil::TouserData<int32>(InLuaState, 2, \"int32\");"));
 	funcBody += EndLinePrintf(TEXT("\t%s pItem = %s(*pTArray)[ArrayIndex];"), *m_ElementInfo.DeclareType, *m_ElementInfo.AssignValuePrefix);
 	if (m_ElementInfo.bNeedNewPushValue)
@@ -103,6 +103,10 @@ FExtraFuncMemberInfo FTArrayGenerator::ExtraGet()
 	{
 		funcBody += EndLinePrintf(TEXT("\tFLuaUtil::Push(InLuaState, FLuaClassType<%s>(pItem, \"%s\"));"), *m_ElementInfo.TouserPushDeclareType, *m_ElementInfo.TouserPushPureType);
 	}
+	if (m_ElementInfo.AssignValuePrefix == "&")
+	{ // the element lives inside the array
+		funcBody += EndLinePrintf(TEXT("\tFLuaUtil::SetOwner(InLuaState, -1, 1);"));
+	}
 	funcBody += EndLinePrintf(TEXT("\treturn 1;"));
 	return ExtraInfo;
 }
@@ -119,7 +123,7 @@ FExtraFuncMemberInfo FTArrayGenerator::ExtraSet()
 	FExtraFuncMemberInfo ExtraInfo;
 	ExtraInfo.funcName = "Set";
 	FString &funcBody = ExtraInfo.funcBody;
-	funcBody += EndLinePrintf(TEXT("\t%s *pTArray = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *m_TArrayInfo.PureType, *m_TArrayInfo.PureType, *m_TArrayInfo.PureType);
+	funcBody += EndLinePrintf(TEXT("\t%s *pTArray = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *m_TArrayInfo.PureType, *m_TArrayInfo.PureType, *m_TArrayInfo.PureType);
 	funcBody += EndLinePrintf(TEXT("\tint32 ArrayIndex = FLuaUtil::TouserData<int32>(InLuaState, 2, \"int32\");"));
 	funcBody += EndLinePrintf(TEXT("\t%s ArrayItem = %sFLuaUtil::TouserData<%s>(InLuaState, 3, \"%s\");"), *m_ElementInfo.DeclareType, *m_ElementInfo.CastType, *m_ElementInfo.TouserPushDeclareType, *m_ElementInfo.TouserPushPureType);
 	funcBody += EndLinePrintf(TEXT("\t(*pTArray)[ArrayIndex] = %sArrayItem;"), *m_ElementInfo.UsedSelfVarPrefix);
@@ -132,7 +136,7 @@ FExtraFuncMemberInfo FTArrayGenerator::ExtraEmpty()
 	FExtraFuncMemberInfo ExtraInfo;
 	ExtraInfo.funcName = "Empty";
 	FString &funcBody = ExtraInfo.funcBody;
-	funcBody += EndLinePrintf(TEXT("\t%s *pTArray = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *m_TArrayInfo.PureType, *m_TArrayInfo.PureType, *m_TArrayInfo.PureType);
+	funcBody += EndLinePrintf(TEXT("\t%s *pTArray = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *m_TArrayInfo.PureType, *m_TArrayInfo.PureType, *m_TArrayInfo.PureType);
 	funcBody += EndLinePrintf(TEXT("\tpTArray->Empty();"));
 	funcBody += EndLinePrintf(TEXT("\treturn 0;"));
 	return ExtraInfo;
@@ -143,7 +147,7 @@ FExtraFuncMemberInfo FTArrayGenerator::ExtraCopy()
 	FExtraFuncMemberInfo ExtraInfo;
 	ExtraInfo.funcName = "Copy";
 	FString &funcBody = ExtraInfo.funcBody;
-	funcBody += EndLinePrintf(TEXT("\t%s *pSrc = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *m_TArrayInfo.PureType, *m_TArrayInfo.PureType, *m_TArrayInfo.PureType);
+	funcBody += EndLinePrintf(TEXT("\t%s *pSrc = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *m_TArrayInfo.PureType, *m_TArrayInfo.PureType, *m_TArrayInfo.PureType);
 	funcBody += EndLinePrintf(TEXT("\t%s *pDest = FLuaUtil::TouserData<%s*>(InLuaState, 2, \"%s\");"), *m_TArrayInfo.PureType, *m_TArrayInfo.PureType, *m_TArrayInfo.PureType);
 	funcBody += EndLinePrintf(TEXT("\t*pSrc = *pDest;"));
 	funcBody += EndLinePrintf(TEXT("\treturn 0;"));
@@ -155,7 +159,7 @@ FExtraFuncMemberInfo FTArrayGenerator::ExtraRemoveAt()
 	FExtraFuncMemberInfo ExtraInfo;
 	ExtraInfo.funcName = "RemoveAt";
 	FString &funcBody = ExtraInfo.funcBody;
-	funcBody += EndLinePrintf(TEXT("\t%s *pTArray = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *m_TArrayInfo.PureType, *m_TArrayInfo.PureType, *m_TArrayInfo.PureType);
+	funcBody += EndLinePrintf(TEXT("\t%s *pTArray = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *m_TArrayInfo.PureType, *m_TArrayInfo.PureType, *m_TArrayInfo.PureType);
 	funcBody += EndLinePrintf(TEXT("\tint32 ArrayIndex = FLuaUtil::TouserData<int32>(InLuaState, 2, \"int32\");"));
 	funcBody += EndLinePrintf(TEXT("\tpTArray->RemoveAt(ArrayIndex);"));
 	funcBody += EndLinePrintf(TEXT("\treturn 0;"));
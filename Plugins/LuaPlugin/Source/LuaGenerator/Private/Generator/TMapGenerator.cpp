@@ -50,7 +50,7 @@ void FTMapGenerator::SaveToFile()
 	FileContent += m_LuaFuncReg.GetRegLibContents();
 	FileContent += GetFileTail();
 
-	if (!FFileHelper::SaveStringToFile(FileContent, *FilePathName))
+	if (!SaveFileContent(FileContent, FilePathName))
 	{
 		UE_LOG(LogLuaGenerator, Error, TEXT("Failed to save header export:%s"), *GetFileName());
 	}
@@ -66,7 +66,7 @@ FExtraFuncMemberInfo FTMapGenerator::ExtraNum()
 	FExtraFuncMemberInfo ExtraInfo;
 	ExtraInfo.funcName = "Num";
 	FString &funcBody = ExtraInfo.funcBody;
-	funcBody += EndLinePrintf(TEXT("\t%s *pMap = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *m_TMapInfo.PureType, *m_TMapInfo.PureType, *m_TMapInfo.PureType);
+	funcBody += EndLinePrintf(TEXT("\t%s *pMap = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *m_TMapInfo.PureType, *m_TMapInfo.PureType, *m_TMapInfo.PureType);
 	funcBody += EndLinePrintf(TEXT("\tint32 MapNum = pMap->Num();"));
 	funcBody += EndLinePrintf(TEXT("\tFLuaUtil::Push(InLuaState, FLuaClassType<int32>(MapNum, \"int32\"));"));
 	funcBody += EndLinePrintf(TEXT("\treturn 1;"));
@@ -78,7 +78,7 @@ FExtraFuncMemberInfo FTMapGenerator::ExtraAdd()
 	FExtraFuncMemberInfo ExtraInfo;
 	ExtraInfo.funcName = "Add";
 	FString &funcBody = ExtraInfo.funcBody;
-	funcBody += EndLinePrintf(TEXT("\t%s *pMap = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *m_TMapInfo.PureType, *m_TMapInfo.PureType, *m_TMapInfo.PureType);
+	funcBody += EndLinePrintf(TEXT("\t%s *pMap = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *m_TMapInfo.PureType, *m_TMapInfo.PureType, *m_TMapInfo.PureType);
 	funcBody += EndLinePrintf(TEXT("\t%s MapKey = %sFLuaUtil::TouserData<%s>(InLuaState, 2, \"%s\");"), *m_KeyInfo.DeclareType, *m_KeyInfo.CastType, *m_KeyInfo.TouserPushDeclareType, *m_KeyInfo.TouserPushPureType);
 	funcBody += EndLinePrintf(TEXT("\t%s MapValue = FLuaUtil::TouserData<%s>(InLuaState, 3, \"%s\");"), *m_ValueInfo.DeclareType, *m_ValueInfo.DeclareType, *m_ValueInfo.TouserPushDeclareType, *m_ValueInfo.TouserPushPureType);
 	funcBody += EndLinePrintf(TEXT("\tpMap->Add(%sMapKey, %sMapValue);"), *m_KeyInfo.UsedSelfVarPrefix, *m_ValueInfo.UsedSelfVarPrefix);
@@ -91,7 +91,7 @@ FExtraFuncMemberInfo FTMapGenerator::ExtraFind()
 	FExtraFuncMemberInfo ExtraInfo;
 	ExtraInfo.funcName = "Find";
 	FString &funcBody = ExtraInfo.funcBody;
-	funcBody += EndLinePrintf(TEXT("\t%s *pMap = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *m_TMapInfo.PureType, *m_TMapInfo.PureType, *m_TMapInfo.PureType);
+	funcBody += EndLinePrintf(TEXT("\t%s *pMap = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *m_TMapInfo.PureType, *m_TMapInfo.PureType, *m_TMapInfo.PureType);
 	funcBody += EndLinePrintf(TEXT("\t%s MapKey = %sFLuaUtil::TouserData<%s>(InLuaState, 2, \"%s\");"), *m_KeyInfo.DeclareType, *m_KeyInfo.CastType, *m_KeyInfo.TouserPushDeclareType, *m_KeyInfo.TouserPushPureType);
 	funcBody += EndLinePrintf(TEXT("\t%s pMapValue = pMap->Find(%sMapKey);"), *m_ValueInfo.PointTValueDeclare, *m_KeyInfo.UsedSelfVarPrefix);
 	funcBody += EndLinePrintf(TEXT("\tif (pMapValue)"));
@@ -104,6 +104,10 @@ FExtraFuncMemberInfo FTMapGenerator::ExtraFind()
 	else
 	{
 		funcBody += EndLinePrintf(TEXT("\t\tFLuaUtil::Push(InLuaState, FLuaClassType<%s>(%spMapValue, \"%s\"));"), *m_ValueInfo.TouserPushDeclareType, *m_ValueInfo.PushPointTValuePrefix, *m_ValueInfo.TouserPushPureType);
+		if (m_ValueInfo.AssignValuePrefix == "&")
+		{ // the value lives inside the map
+			funcBody += EndLinePrintf(TEXT("\t\tFLuaUtil::SetOwner(InLuaState, -1, 1);"));
+		}
 	}
 	funcBody += EndLinePrintf(TEXT("\t}"));
 	funcBody += EndLinePrintf(TEXT("\telse"));
@@ -119,7 +123,7 @@ FExtraFuncMemberInfo FTMapGenerator::ExtraContains()
 	FExtraFuncMemberInfo ExtraInfo;
 	ExtraInfo.funcName = "Contains";
 	FString &funcBody = ExtraInfo.funcBody;
-	funcBody += EndLinePrintf(TEXT("\t%s *pMap = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *m_TMapInfo.PureType, *m_TMapInfo.PureType, *m_TMapInfo.PureType);
+	funcBody += EndLinePrintf(TEXT("\t%s *pMap = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *m_TMapInfo.PureType, *m_TMapInfo.PureType, *m_TMapInfo.PureType);
 	funcBody += EndLinePrintf(TEXT("\t%s MapKey = %sFLuaUtil::TouserData<%s>(InLuaState, 2, \"%s\");"), *m_KeyInfo.DeclareType, *m_KeyInfo.CastType, *m_KeyInfo.TouserPushDeclareType, *m_KeyInfo.TouserPushPureType);
 	funcBody += EndLinePrintf(TEXT("\tbool bContain = pMap->Contains(%sMapKey);"), *m_KeyInfo.UsedSelfVarPrefix);
 	funcBody += EndLinePrintf(TEXT("\tFLuaUtil::Push(InLuaState, FLuaClassType<bool>(bContain, \"bool\"));"));
@@ -132,7 +136,7 @@ FExtraFuncMemberInfo FTMapGenerator::ExtraEmpty()
 	FExtraFuncMemberInfo ExtraInfo;
 	ExtraInfo.funcName = "Empty";
 	FString &funcBody = ExtraInfo.funcBody;
-	funcBody += EndLinePrintf(TEXT("\t%s *pMap = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *m_TMapInfo.PureType, *m_TMapInfo.PureType, *m_TMapInfo.PureType);
+	funcBody += EndLinePrintf(TEXT("\t%s *pMap = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *m_TMapInfo.PureType, *m_TMapInfo.PureType, *m_TMapInfo.PureType);
 	funcBody += EndLinePrintf(TEXT("\tpMap->Empty();"));
 	funcBody += EndLinePrintf(TEXT("\treturn 0;"));
 	return ExtraInfo;
@@ -143,7 +147,7 @@ FExtraFuncMemberInfo FTMapGenerator::ExtraRemove()
 	FExtraFuncMemberInfo ExtraInfo;
 	ExtraInfo.funcName = "Remove";
 	FString &funcBody = ExtraInfo.funcBody;
-	funcBody += EndLinePrintf(TEXT("\t%s *pMap = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *m_TMapInfo.PureType, *m_TMapInfo.PureType, *m_TMapInfo.PureType);
+	funcBody += EndLinePrintf(TEXT("\t%s *pMap = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *m_TMapInfo.PureType, *m_TMapInfo.PureType, *m_TMapInfo.PureType);
 	funcBody += EndLinePrintf(TEXT("\t%s MapKey = %sFLuaUtil::TouserData<%s>(InLuaState, 2, \"%s\");"), *m_KeyInfo.DeclareType, *m_KeyInfo.CastType, *m_KeyInfo.TouserPushDeclareType, *m_KeyInfo.TouserPushPureType);
 	funcBody += EndLinePrintf(TEXT("\tpMap->Remove(%sMapKey);"), *m_KeyInfo.UsedSelfVarPrefix);
 	funcBody += EndLinePrintf(TEXT("\treturn 0;"));
@@ -49,7 +49,7 @@ void FTSetGenerator::SaveToFile()
 	FileContent += m_LuaFuncReg.GetRegLibContents();
 	FileContent += GetFileTail();
 
-	if (!FFileHelper::SaveStringToFile(FileContent, *FilePathName))
+	if (!SaveFileContent(FileContent, FilePathName))
 	{
 		UE_LOG(LogLuaGenerator, Error, TEXT("Failed to save header export:%s"), *GetFileName());
 	}
@@ -65,7 +65,7 @@ FExtraFuncMemberInfo FTSetGenerator::ExtraNum()
 	FExtraFuncMemberInfo ExtraInfo;
 	ExtraInfo.funcName = "Num";
 	FString &funcBody = ExtraInfo.funcBody;
-	funcBody += EndLinePrintf(TEXT("\t%s *pTSet = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *m_TSetInfo.PureType, *m_TSetInfo.PureType, *m_TSetInfo.PureType);
+	funcBody += EndLinePrintf(TEXT("\t%s *pTSet = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *m_TSetInfo.PureType, *m_TSetInfo.PureType, *m_TSetInfo.PureType);
 	funcBody += EndLinePrintf(TEXT("\tint32 TSetNum = pTSet->Num();"));
 	funcBody += EndLinePrintf(TEXT("\tFLuaUtil::Push(InLuaState, FLuaClassType<int32>(TSetNum, \"int32\"));"));
 	funcBody += EndLinePrintf(TEXT("\treturn 1;"));
@@ -77,7 +77,7 @@ FExtraFuncMemberInfo FTSetGenerator::ExtraAdd()
 	FExtraFuncMemberInfo ExtraInfo;
 	ExtraInfo.funcName = "Add";
 	FString &funcBody = ExtraInfo.funcBody;
-	funcBody += EndLinePrintf(TEXT("\t%s *pTSet = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *m_TSetInfo.PureType, *m_TSetInfo.PureType, *m_TSetInfo.PureType);
+	funcBody += EndLinePrintf(TEXT("\t%s *pTSet = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *m_TSetInfo.PureType, *m_TSetInfo.PureType, *m_TSetInfo.PureType);
 	funcBody += EndLinePrintf(TEXT("\t%s ElementInfo = %sFLuaUtil::TouserData<%s>(InLuaState, 2, \"%s\");"), *m_ElementInfo.DeclareType, *m_ElementInfo.CastType, *m_ElementInfo.TouserPushDeclareType, *m_ElementInfo.TouserPushPureType);
 	funcBody += EndLinePrintf(TEXT("\tpTSet->Add(%sElementInfo);"), *m_ElementInfo.UsedSelfVarPrefix);
 	funcBody += EndLinePrintf(TEXT("\treturn 0;"));
@@ -89,7 +89,7 @@ FExtraFuncMemberInfo FTSetGenerator::ExtraEmpty()
 	FExtraFuncMemberInfo ExtraInfo;
 	ExtraInfo.funcName = "Empty";
 	FString &funcBody = ExtraInfo.funcBody;
-	funcBody += EndLinePrintf(TEXT("\t%s *pTSet = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *m_TSetInfo.PureType, *m_TSetInfo.PureType, *m_TSetInfo.PureType);
+	funcBody += EndLinePrintf(TEXT("\t%s *pTSet = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *m_TSetInfo.PureType, *m_TSetInfo.PureType, *m_TSetInfo.PureType);
 	funcBody += EndLinePrintf(TEXT("\tpTSet->Empty();"));
 	funcBody += EndLinePrintf(TEXT("\treturn 0;"));
 	return ExtraInfo;
@@ -100,7 +100,7 @@ FExtraFuncMemberInfo FTSetGenerator::ExtraRemove()
 	FExtraFuncMemberInfo ExtraInfo;
 	ExtraInfo.funcName = "Remove";
 	FString &funcBody = ExtraInfo.funcBody;
-	funcBody += EndLinePrintf(TEXT("\t%s *pTSet = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *m_TSetInfo.PureType, *m_TSetInfo.PureType, *m_TSetInfo.PureType);
+	funcBody += EndLinePrintf(TEXT("\t%s *pTSet = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *m_TSetInfo.PureType, *m_TSetInfo.PureType, *m_TSetInfo.PureType);
 	funcBody += EndLinePrintf(TEXT("\t%s ElementInfo = %sFLuaUtil::TouserData<%s>(InLuaState, 2, \"%s\");"), *m_ElementInfo.DeclareType, *m_ElementInfo.CastType, *m_ElementInfo.TouserPushDeclareType, *m_ElementInfo.TouserPushPureType);
 	funcBody += EndLinePrintf(TEXT("\tpTSet->Remove(%sElementInfo);"), *m_ElementInfo.UsedSelfVarPrefix);
 	funcBody += EndLinePrintf(TEXT("\treturn 0;"));
@@ -112,7 +112,7 @@ FExtraFuncMemberInfo FTSetGenerator::ExtraContains()
 	FExtraFuncMemberInfo ExtraInfo;
 	ExtraInfo.funcName = "Contains";
 	FString &funcBody = ExtraInfo.funcBody;
-	funcBody += EndLinePrintf(TEXT("\t%s *pTSet = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *m_TSetInfo.PureType, *m_TSetInfo.PureType, *m_TSetInfo.PureType);
+	funcBody += EndLinePrintf(TEXT("\t%s *pTSet = FLuaUtil::TouserSelf<%s*>(InLuaState, \"%s\");"), *m_TSetInfo.PureType, *m_TSetInfo.PureType, *m_TSetInfo.PureType);
 	funcBody += EndLinePrintf(TEXT("\t%s ElementInfo = %sFLuaUtil::TouserData<%s>(InLuaState, 2, \"%s\");"), *m_ElementInfo.DeclareType, *m_ElementInfo.CastType, *m_ElementInfo.TouserPushDeclareType, *m_ElementInfo.TouserPushPureType);
 	funcBody += EndLinePrintf(TEXT("\tbool bContain = pTSet->Contains(%sElementInfo);"), *m_ElementInfo.UsedSelfVarPrefix);
 	funcBody += EndLinePrintf(TEXT("\tFLuaUtil::Push(InLuaState, FLuaClassType<bool>(bContain, \"bool\"));"));
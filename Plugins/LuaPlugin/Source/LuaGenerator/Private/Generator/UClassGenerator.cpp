@@ -45,7 +45,7 @@ void FUClassGenerator::SaveToFile()
 	FileContent += GetFileRegContents();
 	FileContent += GetFileTail();
 
-	if (!FFileHelper::SaveStringToFile(FileContent, *FilePathName))
+	if (!SaveFileContent(FileContent, FilePathName))
 	{
 		UE_LOG(LogLuaGenerator, Error, TEXT("Failed to save header export:%s"), *GetFileName());
 	}
@@ -56,6 +56,19 @@ FString FUClassGenerator::GetClassName() const
 	return FString::Printf(TEXT("%s%s"), m_pClass->GetPrefixCPP(), *m_pClass->GetName());
 }
 
+FString FUClassGenerator::GetTypeParentName() const
+{ // nearest exported super class
+	for (UClass *pSuperClass = m_pClass->GetSuperClass(); pSuperClass; pSuperClass = pSuperClass->GetSuperClass())
+	{
+		FString SuperClassName = FString::Printf(TEXT("%s%s"), pSuperClass->GetPrefixCPP(), *pSuperClass->GetName());
+		if (g_ScriptGeneratorManager->ContainClassName(SuperClassName))
+		{
+			return SuperClassName;
+		}
+	}
+	return FString();
+}
+
 void FUClassGenerator::ExportDataMembersToMemory()
 {
 	for (TFieldIterator<UProperty> PropertyIt(m_pClass/*, EFieldIteratorFlags::ExcludeSuper*/); PropertyIt; ++PropertyIt)
@@ -102,7 +115,7 @@ FExtraFuncMemberInfo FUClassGenerator::GenerateNewExportFunction()
 	funcBody += EndLinePrintf(TEXT("\tFName Name = FLuaUtil::TouserData<FName>(InLuaState, 2, \"FName\");"));
 	//funcBody += EndLinePrintf(TEXT("\tFName Name = FName(luaL_checkstring(InLuaState, 2));"));
 	funcBody += EndLinePrintf(TEXT("\t%s* pObj = NewObject<%s>(Outer, Name);"), *GetClassName(), *GetClassName());
-	funcBody += EndLinePrintf(TEXT("\tFLuaUtil::Push(InLuaState, FLuaClassType<%s*>(pObj, \"%s\"));"), *GetClassName(), *GetClassName());
+	funcBody += EndLinePrintf(TEXT("\tFLuaUtil::PushRootedObject(InLuaState, pObj, \"%s\");"), *GetClassName());
 	funcBody += EndLinePrintf(TEXT("\treturn 1;"));
 
 	return ExtraFuncNew;
@@ -3,6 +3,7 @@
 #include "Templates/Casts.h"
 #include "Misc/FileHelper.h"
 #include "UObjectIterator.h"
+#include "ScriptGeneratorManager.h"
 
 IScriptGenerator* FUStructGenerator::CreateGenerator(UScriptStruct *InScriptStruct, const FString &InOutDir)
 {
@@ -62,7 +63,7 @@ void FUStructGenerator::SaveToFile()
 	FileContent += GetRegContents();
 	FileContent += GetFileTail();
 
-	if (!FFileHelper::SaveStringToFile(FileContent, *FilePathName))
+	if (!SaveFileContent(FileContent, FilePathName))
 	{
 		UE_LOG(LogLuaGenerator, Error, TEXT("FUStructGenerator Failed to save export header:%s"), *GetFileName());
 	}
@@ -73,6 +74,19 @@ FString FUStructGenerator::GetClassName() const
 	return FString::Printf(TEXT("%s%s"), m_pScriptStruct->GetPrefixCPP(), *m_pScriptStruct->GetName());
 }
 
+FString FUStructGenerator::GetTypeParentName() const
+{ // nearest exported super struct
+	for (UStruct *pSuperStruct = m_pScriptStruct->GetSuperStruct(); pSuperStruct; pSuperStruct = pSuperStruct->GetSuperStruct())
+	{
+		FString SuperStructName = FString::Printf(TEXT("%s%s"), pSuperStruct->GetPrefixCPP(), *pSuperStruct->GetName());
+		if (g_ScriptGeneratorManager->ContainClassName(SuperStructName))
+		{
+			return SuperStructName;
+		}
+	}
+	return FString();
+}
+
 void FUStructGenerator::ExportDataMemberToMemory()
 {
 	for (TFieldIterator<UProperty> PropertyIt(m_pScriptStruct/*, EFieldIteratorFlags::ExcludeSuper*/); PropertyIt; ++PropertyIt)
@@ -102,6 +116,17 @@ void FUStructGenerator::ExportExtraFuncsToMemory()
 {
 	m_LuaFuncReg.AddExtraFuncMember(GenerateNewExportFunction());
 	m_LuaFuncReg.AddExtraFuncMember(GenerateDestoryExportFunction());
+
+	if (g_LuaConfigManager->MathStructs.Contains(GetClassName()))
+	{ // metamethods go into the class metatable along with the other lib functions
+		m_LuaFuncReg.AddExtraFuncMember(GenerateMathOpExportFunction(TEXT("__add"), TEXT("Add")));
+		m_LuaFuncReg.AddExtraFuncMember(GenerateMathOpExportFunction(TEXT("__sub"), TEXT("Sub")));
+		m_LuaFuncReg.AddExtraFuncMember(GenerateMathOpExportFunction(TEXT("__mul"), TEXT("Mul")));
+		m_LuaFuncReg.AddExtraFuncMember(GenerateMathOpExportFunction(TEXT("__eq"), TEXT("Eq")));
+		m_LuaFuncReg.AddExtraFuncMember(GenerateMathOpExportFunction(TEXT("AddInPlace"), TEXT("AddInPlace")));
+		m_LuaFuncReg.AddExtraFuncMember(GenerateMathOpExportFunction(TEXT("SubInPlace"), TEXT("SubInPlace")));
+		m_LuaFuncReg.AddExtraFuncMember(GenerateMathOpExportFunction(TEXT("MulInPlace"), TEXT("MulInPlace")));
+	}
 }
 
 bool FUStructGenerator::CanExportFunction(UFunction *InFunction)
@@ -135,8 +160,7 @@ FExtraFuncMemberInfo FUStructGenerator::GenerateNewExportFunction()
 	FExtraFuncMemberInfo ExtraFuncNew;
 	ExtraFuncNew.funcName = "New";
 	FString &funcBody = ExtraFuncNew.funcBody;
-	funcBody += EndLinePrintf(TEXT("\t%s *pStruct = new %s;"), *GetClassName(), *GetClassName());
-	funcBody += EndLinePrintf(TEXT("\tFLuaUtil::Push(InLuaState, FLuaClassType<%s*>(pStruct, \"%s\"));"), *GetClassName(), *GetClassName());
+	funcBody += EndLinePrintf(TEXT("\tFLuaUtil::Push(InLuaState, FLuaValueType<%s>(%s(), \"%s\"));"), *GetClassName(), *GetClassName(), *GetClassName());
 	funcBody += EndLinePrintf(TEXT("\treturn 1;"));
 
 	return ExtraFuncNew;
@@ -147,9 +171,16 @@ FExtraFuncMemberInfo FUStructGenerator::GenerateDestoryExportFunction()
 	FExtraFuncMemberInfo ExtraFuncDestory;
 	ExtraFuncDestory.funcName = "Destory";
 	FString &funcBody = ExtraFuncDestory.funcBody;
-	funcBody += EndLinePrintf(TEXT("\t%s *pStruct = FLuaUtil::TouserData<%s*>(InLuaState, 1, \"%s\");"), *GetClassName(), *GetClassName(), *GetClassName());
-	funcBody += EndLinePrintf(TEXT("\tif(pStruct) delete pStruct;"));
-	funcBody += EndLinePrintf(TEXT("\tpStruct = nullptr;"));
+	funcBody += EndLinePrintf(TEXT("\tFLuaUtil::ReleaseUserData(InLuaState, 1);"));
 	funcBody += EndLinePrintf(TEXT("\treturn 0;"));
 	return ExtraFuncDestory;
 }
+
+FExtraFuncMemberInfo FUStructGenerator::GenerateMathOpExportFunction(const FString &FuncName, const FString &OpName)
+{
+	FExtraFuncMemberInfo ExtraFuncOp;
+	ExtraFuncOp.funcName = FuncName;
+	ExtraFuncOp.funcBody += EndLinePrintf(TEXT("\treturn TLuaMathOps<%s>::%s(InLuaState, \"%s\");"), *GetClassName(), *OpName, *GetClassName());
+
+	return ExtraFuncOp;
+}
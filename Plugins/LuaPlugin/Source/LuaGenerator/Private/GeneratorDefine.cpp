@@ -1,6 +1,7 @@
 #include "GeneratorDefine.h"
 #include "CoreUObject.h"
 #include "ScriptGeneratorManager.h"
+#include "Misc/FileHelper.h"
 
 FScriptGeneratorManager *g_ScriptGeneratorManager = nullptr;
 FLuaConfigManager *g_LuaConfigManager = nullptr;
@@ -532,4 +533,15 @@ namespace NS_LuaGenerator
 		OuterType = Property->GetCPPType(&InnerType);
 		return FString::Printf(TEXT("%s%s"), *OuterType, *InnerType);
 	}
+
+	bool SaveFileIfChanged(const FString &FileContent, const FString &FilePathName)
+	{ // an untouched timestamp keeps UBT from rebuilding everything that includes the header
+		FString OldContent;
+		if (FFileHelper::LoadFileToString(OldContent, *FilePathName) && OldContent.Equals(FileContent, ESearchCase::CaseSensitive))
+		{
+			return true;
+		}
+
+		return FFileHelper::SaveStringToFile(FileContent, *FilePathName);
+	}
 }
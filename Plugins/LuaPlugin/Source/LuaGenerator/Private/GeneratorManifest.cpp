@@ -0,0 +1,114 @@
+#include "GeneratorManifest.h"
+#include "GeneratorDefine.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/JsonSerializer.h"
+
+// bump when the generated code changes so old manifests regenerate everything
+static const int32 GeneratorManifestVersion = 1;
+
+FGeneratorManifest::FGeneratorManifest()
+	: m_bLoaded(false)
+	, m_ConfigHash(0)
+{
+
+}
+
+bool FGeneratorManifest::Load(const FString &FilePathName, uint32 InConfigHash)
+{
+	Reset(InConfigHash);
+
+	FString JsonStr;
+	TSharedPtr<FJsonObject> JsonManifest;
+	if (!FFileHelper::LoadFileToString(JsonStr, *FilePathName))
+	{
+		return false;
+	}
+
+	TSharedRef<TJsonReader<TCHAR>> JsonReader = TJsonReaderFactory<TCHAR>::Create(JsonStr);
+	if (!FJsonSerializer::Deserialize(JsonReader, JsonManifest) || !JsonManifest.IsValid())
+	{
+		UE_LOG(LogLuaGenerator, Warning, TEXT("FGeneratorManifest::Load %s is not valid json, export everything"), *FilePathName);
+		return false;
+	}
+
+	double Version = 0;
+	double ConfigHash = 0;
+	JsonManifest->TryGetNumberField(TEXT("Version"), Version);
+	JsonManifest->TryGetNumberField(TEXT("ConfigHash"), ConfigHash);
+	if ((int32)Version != GeneratorManifestVersion || (uint32)ConfigHash != InConfigHash)
+	{ // older generator or different config, the old output cannot be trusted
+		return false;
+	}
+
+	const TSharedPtr<FJsonObject> *pJsonEntries = nullptr;
+	if (!JsonManifest->TryGetObjectField(TEXT("Generators"), pJsonEntries))
+	{
+		return false;
+	}
+
+	for (const auto &JsonItem : (*pJsonEntries)->Values)
+	{
+		TSharedPtr<FJsonObject> JsonEntry = JsonItem.Value->AsObject();
+		double ContentHash = 0;
+		if (!JsonEntry.IsValid() || !JsonEntry->TryGetNumberField(TEXT("Hash"), ContentHash))
+		{
+			continue;
+		}
+
+		FGeneratorManifestEntry Entry;
+		Entry.ContentHash = (uint32)ContentHash;
+		JsonEntry->TryGetStringArrayField(TEXT("Parents"), Entry.ParentNames);
+		JsonEntry->TryGetStringArrayField(TEXT("Dependencies"), Entry.Dependencies);
+		m_Entries.Add(JsonItem.Key, Entry);
+	}
+
+	m_bLoaded = true;
+	return true;
+}
+
+bool FGeneratorManifest::Save(const FString &FilePathName) const
+{
+	TSharedRef<FJsonObject> JsonEntries = MakeShareable(new FJsonObject());
+	for (const auto &EntryItem : m_Entries)
+	{
+		const FGeneratorManifestEntry &Entry = EntryItem.Value;
+		TArray<TSharedPtr<FJsonValue>> JsonParents;
+		for (const FString &ParentName : Entry.ParentNames)
+		{
+			JsonParents.Add(MakeShareable(new FJsonValueString(ParentName)));
+		}
+
+		TArray<TSharedPtr<FJsonValue>> JsonDependencies;
+		for (const FString &Dependency : Entry.Dependencies)
+		{
+			JsonDependencies.Add(MakeShareable(new FJsonValueString(Dependency)));
+		}
+
+		TSharedRef<FJsonObject> JsonEntry = MakeShareable(new FJsonObject());
+		JsonEntry->SetNumberField(TEXT("Hash"), Entry.ContentHash);
+		JsonEntry->SetArrayField(TEXT("Parents"), JsonParents);
+		JsonEntry->SetArrayField(TEXT("Dependencies"), JsonDependencies);
+		JsonEntries->SetObjectField(EntryItem.Key, JsonEntry);
+	}
+
+	TSharedRef<FJsonObject> JsonManifest = MakeShareable(new FJsonObject());
+	JsonManifest->SetNumberField(TEXT("Version"), GeneratorManifestVersion);
+	JsonManifest->SetNumberField(TEXT("ConfigHash"), m_ConfigHash);
+	JsonManifest->SetObjectField(TEXT("Generators"), JsonEntries);
+
+	FString JsonStr;
+	TSharedRef<TJsonWriter<TCHAR>> JsonWriter = TJsonWriterFactory<TCHAR>::Create(&JsonStr);
+	if (!FJsonSerializer::Serialize(JsonManifest, JsonWriter))
+	{
+		return false;
+	}
+
+	return FFileHelper::SaveStringToFile(JsonStr, *FilePathName);
+}
+
+void FGeneratorManifest::Reset(uint32 InConfigHash)
+{
+	m_bLoaded = false;
+	m_ConfigHash = InConfigHash;
+	m_Entries.Empty();
+}
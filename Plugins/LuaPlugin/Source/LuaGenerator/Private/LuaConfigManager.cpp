@@ -14,6 +14,7 @@ void FLuaConfigManager::Init()
 	ClassScriptHeaderSuffix = ".script.h";
 	ClassConfigFileRelativeFolder = "Config";
 	NoExportExtraFuncName = "NoExport";
+	bIncrementalExport = false;
 
 	FString ProjectFilePath = FPaths::GetProjectFilePath();
 	ProjectPath = FPaths::GetPath(ProjectFilePath);
@@ -22,10 +23,12 @@ void FLuaConfigManager::Init()
 
 	GConfig->GetArray(TEXT("BaseTypes"), TEXT("TypeName"), BaseTypes, ConfigFilePath);
 	GConfig->GetArray(TEXT("SupportStructs"), TEXT("StructName"), SupportStructs, ConfigFilePath);
+	GConfig->GetArray(TEXT("MathStructs"), TEXT("StructName"), MathStructs, ConfigFilePath);
 	GConfig->GetArray(TEXT("NotSupportClass"), TEXT("ClassName"), NotSuportClasses, ConfigFilePath);
 	GConfig->GetArray(TEXT("SupportModules"), TEXT("ModuleName"), SupportedModules, ConfigFilePath);
 	GConfig->GetArray(TEXT("ConfigClassFiles"), TEXT("ConfigClassFileName"), ClassConfigFileNames, ConfigFilePath);
 	GConfig->GetArray(TEXT("AdditionalIncludeHeaders"), TEXT("IncludeHeader"), AdditionalIncludeHeaders, ConfigFilePath);
+	GConfig->GetBool(TEXT("Generator"), TEXT("bIncrementalExport"), bIncrementalExport, ConfigFilePath);
 
 	if (!FPaths::IsProjectFilePathSet())
 	{
@@ -13,6 +13,10 @@
 #include "Generator/TArrayGenerator.h"
 #include "Generator/TMapGenerator.h"
 #include "Generator/TSetGenerator.h"
+#include "Async/ParallelFor.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/Crc.h"
 
 FScriptGeneratorManager::FScriptGeneratorManager()
 {
@@ -31,6 +35,11 @@ void FScriptGeneratorManager::Initialize(const FString& RootLocalPath, const FSt
 	m_RootLocalPath = RootLocalPath;
 	m_RootBuildPath = RootBuildPath;
 	m_IncludeBase = IncludeBase;
+
+	if (g_LuaConfigManager->bIncrementalExport && !m_Manifest.Load(m_OutDir / FString("GeneratorManifest.json"), GetConfigHash()))
+	{
+		UE_LOG(LogLuaGenerator, Display, TEXT("No usable generator manifest, export everything"));
+	}
 }
 
 void FScriptGeneratorManager::ExportClass(UClass* Class, const FString& SourceHeaderFilename, const FString& GeneratedHeaderFilename, bool bHasChanged)
@@ -40,8 +49,15 @@ void FScriptGeneratorManager::ExportClass(UClass* Class, const FString& SourceHe
 	IScriptGenerator *pGenerator = new FUClassGenerator(Class, m_OutDir, SourceHeaderFilename);
 	if (pGenerator && CanExportClass(pGenerator) && pGenerator->CanExport())
 	{
+		m_ExportingKey = pGenerator->GetKey();
 		pGenerator->ExportToMemory();
+		m_ExportingKey.Empty();
 		AddGeneratorToMap(pGenerator);
+
+		if (bHasChanged)
+		{
+			m_ChangedKeys.Add(pGenerator->GetKey());
+		}
 	}
 	else
 	{
@@ -52,11 +68,19 @@ void FScriptGeneratorManager::ExportClass(UClass* Class, const FString& SourceHe
 void FScriptGeneratorManager::FinishExport()
 {
 	DebugProcedure(TEXT("FinishExport"));
+	double StartTime = FPlatformTime::Seconds();
 	ExportExtrasToMemory();
 	AdjustBeforeSaveToFile();
+	double ExportTime = FPlatformTime::Seconds();
 	InitClassParentManager();
+	double ParentTime = FPlatformTime::Seconds();
 	SaveToFiles();
+	double SaveTime = FPlatformTime::Seconds();
 	FinishExportPost();
+	double EndTime = FPlatformTime::Seconds();
+
+	UE_LOG(LogLuaGenerator, Display, TEXT("FinishExport %d generators in %.3fs: extras %.3fs, parents %.3fs, save %.3fs, post %.3fs"),
+		m_Generators.Num(), EndTime - StartTime, ExportTime - StartTime, ParentTime - ExportTime, SaveTime - ParentTime, EndTime - SaveTime);
 }
 
 bool FScriptGeneratorManager::ContainClassName(const FString &ClassName)
@@ -170,6 +194,7 @@ void FScriptGeneratorManager::ExportGeneratorPropertys()
 			{
 				pGenerator->ExportToMemory();
 				AddGeneratorToMap(pGenerator);
+				m_Dependencies.Add(pGenerator->GetKey(), m_GeneratorPropertyUsers.FindRef(Item.Key).Array());
 			}
 			else
 			{
@@ -183,6 +208,7 @@ void FScriptGeneratorManager::ExportGeneratorPropertys()
 			{
 				pGenerator->ExportToMemory();
 				AddGeneratorToMap(pGenerator);
+				m_Dependencies.Add(pGenerator->GetKey(), m_GeneratorPropertyUsers.FindRef(Item.Key).Array());
 			}
 			else
 			{
@@ -196,6 +222,7 @@ void FScriptGeneratorManager::ExportGeneratorPropertys()
 			{
 				pGenerator->ExportToMemory();
 				AddGeneratorToMap(pGenerator);
+				m_Dependencies.Add(pGenerator->GetKey(), m_GeneratorPropertyUsers.FindRef(Item.Key).Array());
 			}
 			else
 			{
@@ -210,7 +237,9 @@ void FScriptGeneratorManager::ExportUStruct(UScriptStruct *pScriptStruct)
 	IScriptGenerator *pGenerator = FUStructGenerator::CreateGenerator(pScriptStruct, m_OutDir);
 	if (pGenerator && CanExportClass(pGenerator) && pGenerator->CanExport())
 	{
+		m_ExportingKey = pGenerator->GetKey();
 		pGenerator->ExportToMemory();
+		m_ExportingKey.Empty();
 		AddGeneratorToMap(pGenerator);
 	}
 	else
@@ -230,21 +259,180 @@ void FScriptGeneratorManager::AddGeneratorProperty(const FString &PlainName, UPr
 	{
 		m_GeneratorPropertys.Add(PlainName, pProperty);
 	}
+
+	if (!m_ExportingKey.IsEmpty())
+	{
+		m_GeneratorPropertyUsers.FindOrAdd(PlainName).Add(m_ExportingKey);
+	}
 }
 
 void FScriptGeneratorManager::SaveToFiles()
 {
 	DebugProcedure(TEXT("SaveToFiles"));
+	TArray<IScriptGenerator*> DirtyGenerators;
+	TArray<IScriptGenerator*> CleanGenerators;
 	for (auto &MapItem : m_Generators)
 	{
 		IScriptGenerator *pGenerator = MapItem.Value;
-		pGenerator->SaveToFile();
+		if (IsGeneratorDirty(pGenerator))
+		{
+			DirtyGenerators.Add(pGenerator);
+		}
+		else
+		{
+			CleanGenerators.Add(pGenerator);
+		}
+	}
+
+	SaveGeneratorsToFiles(DirtyGenerators);
+
+	// parents list every ancestor, so one pass over the rewritten generators whose output changed is enough
+	TSet<FString> ContentChangedKeys;
+	for (IScriptGenerator *pGenerator : DirtyGenerators)
+	{
+		const FGeneratorManifestEntry *pEntry = m_Manifest.Find(pGenerator->GetKey());
+		if (pEntry == nullptr || pEntry->ContentHash != pGenerator->GetContentHash())
+		{
+			ContentChangedKeys.Add(pGenerator->GetKey());
+		}
+	}
+
+	TArray<IScriptGenerator*> DependentGenerators;
+	for (IScriptGenerator *pGenerator : CleanGenerators)
+	{
+		if (DependsOnAny(pGenerator, ContentChangedKeys))
+		{
+			DependentGenerators.Add(pGenerator);
+		}
+	}
+
+	SaveGeneratorsToFiles(DependentGenerators);
+
+	UE_LOG(LogLuaGenerator, Display, TEXT("SaveToFiles regenerated %d of %d generators, %d of them as dependents"),
+		DirtyGenerators.Num() + DependentGenerators.Num(), m_Generators.Num(), DependentGenerators.Num());
+}
+
+void FScriptGeneratorManager::SaveGeneratorsToFiles(const TArray<IScriptGenerator*> &Generators)
+{
+	// after InitClassParentManager the generators only read shared state, so every file can be built and written on its own
+	ParallelFor(Generators.Num(), [&Generators](int32 Index)
+	{
+		Generators[Index]->SaveToFile();
+	}, !FTaskGraphInterface::IsRunning());
+
+	for (IScriptGenerator *pGenerator : Generators)
+	{
+		m_SavedKeys.Add(pGenerator->GetKey());
+	}
+}
+
+uint32 FScriptGeneratorManager::GetConfigHash() const
+{ // any config change may touch every generated file
+	TArray<FString> ConfigFileNames;
+	ConfigFileNames.Add(g_LuaConfigManager->LuaConfigFileRelativePath);
+	ConfigFileNames.Add(FString("Config/ExportConfig.json"));
+	for (const FString &ConfigClassFileName : g_LuaConfigManager->ClassConfigFileNames)
+	{
+		ConfigFileNames.Add(g_LuaConfigManager->ClassConfigFileRelativeFolder / ConfigClassFileName);
+	}
+
+	uint32 ConfigHash = 0;
+	for (const FString &ConfigFileName : ConfigFileNames)
+	{
+		FString ConfigContent;
+		FFileHelper::LoadFileToString(ConfigContent, *(g_LuaConfigManager->ProjectPath / ConfigFileName));
+		ConfigHash = FCrc::StrCrc32(*ConfigContent, ConfigHash);
+	}
+	return ConfigHash;
+}
+
+bool FScriptGeneratorManager::IsGeneratorDirty(IScriptGenerator *InGenerator)
+{
+	const FString Key = InGenerator->GetKey();
+	const FGeneratorManifestEntry *pEntry = m_Manifest.Find(Key);
+	if (!m_Manifest.IsLoaded() || pEntry == nullptr || m_ChangedKeys.Contains(Key))
+	{
+		return true;
+	}
+
+	if (InGenerator->GetType() == NS_LuaGenerator::EUStruct)
+	{ // UHT reports no change for a header with only USTRUCTs, so structs are always generated in memory.
+	  // the file is only written and dependents only follow when the content hash differs from the manifest
+		return true;
+	}
+
+	if (pEntry->ParentNames != GetSortedParentNames(Key))
+	{ // reparented, inherited members and class ids moved
+		return true;
+	}
+
+	return !FPaths::FileExists(m_OutDir / InGenerator->GetFileName());
+}
+
+bool FScriptGeneratorManager::DependsOnAny(IScriptGenerator *InGenerator, const TSet<FString> &Keys)
+{
+	if (Keys.Num() <= 0)
+	{
+		return false;
+	}
+
+	for (const FString &ParentName : GetParentNames(InGenerator->GetKey()))
+	{
+		if (Keys.Contains(ParentName))
+		{
+			return true;
+		}
+	}
+
+	for (const FString &Dependency : m_Dependencies.FindRef(InGenerator->GetKey()))
+	{
+		if (Keys.Contains(Dependency))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+TArray<FString> FScriptGeneratorManager::GetSortedParentNames(const FString &ClassName)
+{
+	TArray<FString> ParentNames = GetParentNames(ClassName);
+	ParentNames.Sort();
+	return ParentNames;
+}
+
+void FScriptGeneratorManager::SaveManifest()
+{
+	if (!g_LuaConfigManager->bIncrementalExport)
+	{
+		return;
+	}
+
+	FGeneratorManifest NewManifest;
+	NewManifest.Reset(GetConfigHash());
+	for (auto &MapItem : m_Generators)
+	{
+		IScriptGenerator *pGenerator = MapItem.Value;
+		const FGeneratorManifestEntry *pOldEntry = m_Manifest.Find(MapItem.Key);
+
+		FGeneratorManifestEntry Entry;
+		Entry.ContentHash = (m_SavedKeys.Contains(MapItem.Key) || pOldEntry == nullptr) ? pGenerator->GetContentHash() : pOldEntry->ContentHash;
+		Entry.ParentNames = GetSortedParentNames(MapItem.Key);
+		Entry.Dependencies = m_Dependencies.FindRef(MapItem.Key);
+		Entry.Dependencies.Sort();
+		NewManifest.SetEntry(MapItem.Key, Entry);
+	}
+
+	if (!NewManifest.Save(m_OutDir / FString("GeneratorManifest.json")))
+	{
+		UE_LOG(LogLuaGenerator, Error, TEXT("Failed to save GeneratorManifest.json:%s"), *(m_OutDir / FString("GeneratorManifest.json")));
 	}
 }
 
 void FScriptGeneratorManager::FinishExportPost()
 {
-	GenerateAndSaveAllHeaderFile();
+	GenerateRegisterShardFiles();
 	GererateLoadAllDefineFile();
 
 	FString PropertyTypes;
@@ -255,66 +443,135 @@ void FScriptGeneratorManager::FinishExportPost()
 
 	FFileHelper::SaveStringToFile(PropertyTypes, *(m_OutDir / FString("PropertyTypes.txt")));
 	FFileHelper::SaveStringToFile(m_LogContent, *(m_OutDir / FString("GeneratorLog.txt")));
+	SaveManifest();
 	DebugProcedure(TEXT("FinishExportPost"));
 }
 
-void FScriptGeneratorManager::GenerateAndSaveAllHeaderFile()
+FString FScriptGeneratorManager::GetRegisterShardName(int32 ShardIndex) const
 {
-	FString AllHeaderFileName("AllHeaders.h");
-	TSet<FString> HeaderFileNames;
-	FString AllHeaderFileContent;
-
-	AllHeaderFileContent += EndLinePrintf(TEXT("#pragma once"));
+	return FString::Printf(TEXT("Shard%d"), ShardIndex);
+}
 
+void FScriptGeneratorManager::GetRegisterShards(TArray<TArray<IScriptGenerator*>> &OutShards) const
+{ // shard by name hash so adding a class only moves that class, every shard sorted in strcmp order for FLuaUtil::RegisterLazyClass
+	TMap<FString, IScriptGenerator*> RegLibsMap;
 	for (auto &MapItem : m_Generators)
 	{
 		IScriptGenerator *pGenerator = MapItem.Value;
-		HeaderFileNames.Add(*pGenerator->GetFileName());
+		RegLibsMap.Add(pGenerator->GetRegName(), pGenerator);
+	}
+
+	OutShards.SetNum(RegisterShardNum);
+	for (auto &RegLibItem : RegLibsMap)
+	{
+		IScriptGenerator *pGenerator = RegLibItem.Value;
+		OutShards[FCrc::StrCrc32(*pGenerator->GetKey()) % RegisterShardNum].Add(pGenerator);
 	}
 
+	for (TArray<IScriptGenerator*> &Shard : OutShards)
+	{
+		Shard.Sort([](const IScriptGenerator &A, const IScriptGenerator &B) { return FCString::Strcmp(*A.GetKey(), *B.GetKey()) < 0; });
+	}
+}
+
+void FScriptGeneratorManager::GenerateRegisterShardFiles()
+{
+	TArray<TArray<IScriptGenerator*>> Shards;
+	GetRegisterShards(Shards);
+
+	for (int32 ShardIndex = 0; ShardIndex < Shards.Num(); ++ShardIndex)
+	{
+		FString ShardFileName = FString("LuaRegister") + GetRegisterShardName(ShardIndex) + g_LuaConfigManager->ClassScriptHeaderSuffix;
+		FString ShardFileContent = GetRegisterShardContent(ShardIndex, Shards[ShardIndex]);
+		if (!NS_LuaGenerator::SaveFileIfChanged(ShardFileContent, m_OutDir / ShardFileName))
+		{
+			UE_LOG(LogLuaGenerator, Error, TEXT("Failed to save %s:%s"), *ShardFileName, *(m_OutDir / ShardFileName));
+		}
+	}
+}
+
+FString FScriptGeneratorManager::GetRegisterShardContent(int32 ShardIndex, const TArray<IScriptGenerator*> &Generators)
+{
+	FString ShardContent;
+	ShardContent += EndLinePrintf(TEXT("#pragma once"));
+	ShardContent += EndLinePrintf(TEXT("#include \"Core.h\""));
+	ShardContent += EndLinePrintf(TEXT("#include \"LuaUtil.h\""));
+	ShardContent += EndLinePrintf(TEXT("#include \"LuaWrapperDefine.h\""));
+
 	for (const FString &IncludeHeader : g_LuaConfigManager->AdditionalIncludeHeaders)
 	{
-		AllHeaderFileContent += EndLinePrintf(TEXT("#include \"%s\""), *IncludeHeader);
+		ShardContent += EndLinePrintf(TEXT("#include \"%s\""), *IncludeHeader);
 	}
 
-	for (const FString &FileName : HeaderFileNames)
+	for (IScriptGenerator *pGenerator : Generators)
 	{
-		AllHeaderFileContent += EndLinePrintf(TEXT("#include \"%s\""), *FileName);
+		ShardContent += EndLinePrintf(TEXT("#include \"%s\""), *pGenerator->GetFileName());
 	}
 
-	if (!FFileHelper::SaveStringToFile(AllHeaderFileContent, *(m_OutDir/AllHeaderFileName)))
+	ShardContent += EndLinePrintf(TEXT(""));
+	ShardContent += EndLinePrintf(TEXT("void Register_%s(lua_State *InLuaState, bool bLazy)"), *GetRegisterShardName(ShardIndex));
+	ShardContent += EndLinePrintf(TEXT("{"));
+	if (Generators.Num() > 0)
 	{
-		UE_LOG(LogLuaGenerator, Error, TEXT("Failed to save AllHeaders.h:%s"), *(m_OutDir / AllHeaderFileName));
+		ShardContent += EndLinePrintf(TEXT("\tif (bLazy)"));
+		ShardContent += EndLinePrintf(TEXT("\t{"));
+		ShardContent += EndLinePrintf(TEXT("\t\tstatic const FLuaClassRegInfo LuaClassRegInfos[] ="));
+		ShardContent += EndLinePrintf(TEXT("\t\t{"));
+		for (IScriptGenerator *pGenerator : Generators)
+		{
+			int32 ClassId = INDEX_NONE;
+			int32 ClassIdEnd = INDEX_NONE;
+			m_ClassParentManager.GetClassIdRange(pGenerator->GetKey(), ClassId, ClassIdEnd);
+			ShardContent += EndLinePrintf(TEXT("\t\t\t{ \"%s\", %s, %s, %s, %d, %d },"), *pGenerator->GetKey(), *pGenerator->GetRegName(), *pGenerator->GetPropertyGetterRegName(), *pGenerator->GetPropertySetterRegName(), ClassId, ClassIdEnd);
+		}
+		ShardContent += EndLinePrintf(TEXT("\t\t};"));
+		ShardContent += EndLinePrintf(TEXT("\t\tFLuaUtil::RegisterLazyClasses(InLuaState, LuaClassRegInfos, ARRAY_COUNT(LuaClassRegInfos));"));
+		ShardContent += EndLinePrintf(TEXT("\t\treturn;"));
+		ShardContent += EndLinePrintf(TEXT("\t}"));
+		ShardContent += EndLinePrintf(TEXT(""));
+	}
+
+	for (IScriptGenerator *pGenerator : Generators)
+	{
+		int32 ClassId = INDEX_NONE;
+		int32 ClassIdEnd = INDEX_NONE;
+		m_ClassParentManager.GetClassIdRange(pGenerator->GetKey(), ClassId, ClassIdEnd);
+		ShardContent += EndLinePrintf(TEXT("\tFLuaUtil::RegisterClass(InLuaState, %s, %s, %s, \"%s\", %d, %d);"), *pGenerator->GetRegName(), *pGenerator->GetPropertyGetterRegName(), *pGenerator->GetPropertySetterRegName(), *pGenerator->GetKey(), ClassId, ClassIdEnd);
 	}
+	ShardContent += EndLinePrintf(TEXT("}"));
+	return ShardContent;
 }
 
 void FScriptGeneratorManager::GererateLoadAllDefineFile()
-{
+{ // the classes are compiled in the LuaRegisterShard translation units, this only calls into them
 	FString LoadAllDefineFileName("LoadAllDefine.h");
-	TMap<FString, FString> RegLibsMap;
 	FString LoadAllDefineFile;
 
 	LoadAllDefineFile += EndLinePrintf(TEXT("#pragma once"));
 	LoadAllDefineFile += EndLinePrintf(TEXT("#ifndef Def_LoadAll"));
-	LoadAllDefineFile += EndLinePrintf(TEXT("#define Def_LoadAll(InLuaState) \\"));
+	for (int32 ShardIndex = 0; ShardIndex < RegisterShardNum; ++ShardIndex)
+	{
+		LoadAllDefineFile += EndLinePrintf(TEXT("void Register_%s(lua_State *InLuaState, bool bLazy);"), *GetRegisterShardName(ShardIndex));
+	}
 
-	for (auto &MapItem : m_Generators)
+	LoadAllDefineFile += EndLinePrintf(TEXT(""));
+	LoadAllDefineFile += EndLinePrintf(TEXT("#define Def_LoadAll(InLuaState) \\"));
+	for (int32 ShardIndex = 0; ShardIndex < RegisterShardNum; ++ShardIndex)
 	{
-		IScriptGenerator *pGenerator = MapItem.Value;
-		RegLibsMap.Add(pGenerator->GetRegName(), pGenerator->GetKey());
+		LoadAllDefineFile += EndLinePrintf(TEXT("\tRegister_%s(InLuaState, false); \\"), *GetRegisterShardName(ShardIndex));
 	}
 
-	for (auto &RegLibItem : RegLibsMap)
+	LoadAllDefineFile += EndLinePrintf(TEXT(""));
+	LoadAllDefineFile += EndLinePrintf(TEXT("#define Def_LazyLoadAll(InLuaState) \\"));
+	for (int32 ShardIndex = 0; ShardIndex < RegisterShardNum; ++ShardIndex)
 	{
-		FString RegLibName = RegLibItem.Key;
-		FString LuaClassName = RegLibItem.Value;
-		LoadAllDefineFile += EndLinePrintf(TEXT("\tFLuaUtil::RegisterClass(InLuaState, %s, \"%s\");\\"), *RegLibName, *LuaClassName);
+		LoadAllDefineFile += EndLinePrintf(TEXT("\tRegister_%s(InLuaState, true); \\"), *GetRegisterShardName(ShardIndex));
 	}
 
 	LoadAllDefineFile += EndLinePrintf(TEXT(""));
 	LoadAllDefineFile += EndLinePrintf(TEXT("#endif"));
 
-	if (!FFileHelper::SaveStringToFile(LoadAllDefineFile, *(m_OutDir / LoadAllDefineFileName)))
+	if (!NS_LuaGenerator::SaveFileIfChanged(LoadAllDefineFile, m_OutDir / LoadAllDefineFileName))
 	{
 		UE_LOG(LogLuaGenerator, Error, TEXT("Failed to save LoadAllDefine.h:%s"), *(m_OutDir / LoadAllDefineFileName));
 	}
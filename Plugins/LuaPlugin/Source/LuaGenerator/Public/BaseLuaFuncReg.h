@@ -107,6 +107,7 @@ private:
 	FString GetLuaGetDataMemberName(const FString &VariableName);
 	FString GetLuaSetDataMemberName(const FString &VariableName);
 
+	FString GetPropertyRegLibContents();
 	FString GetExtraFuncContents();
 	FString GetDataMemberContents();
 	FString GetFuncMemberContents();
@@ -11,20 +11,25 @@ public:
 public:
 	void Init(const TArray<IScriptGenerator*> &ClassGenerators);
 	TArray<FString> GetParentClassNames(const FString &ClassName);
+	bool GetClassIdRange(const FString &ClassName, int32 &OutClassId, int32 &OutClassIdEnd) const;
 
 private:
 	int32 GetClassIndex(const FString &InClassName);
-	void InitParentIndex();
-	void CreateParentMatrix();
-	void InitParentMatrix(const TArray<IScriptGenerator*> &ClassGenerators);
-	void DestoryParentMatrix();
+	void InitDirectParents(const TArray<IScriptGenerator*> &ClassGenerators);
+	void InitAncestors();
+	void CollectAncestors(int32 ClassIndex, TArray<TArray<int32>> &Ancestors, TArray<uint8> &VisitStates);
+	void InitClassIds();
 
 private:
 	int32 m_ClassNum;
 	TMap<FString, int32> m_ClassName2Index;
 	TMap<int32, FString> m_Index2ClassName;
-	bool **m_ParentClassMatrix;
 	int32 m_FirstAvailableIndex;
-	TArray<TArray<int32>> m_ParentIndexs;
+	TArray<TArray<int32>> m_DirectParentIndexs; // only alive during Init
+	TArray<int32> m_AncestorStarts; // m_ClassNum + 1 offsets into m_AncestorIndexs
+	TArray<int32> m_AncestorIndexs; // every class's ancestors back to back, nearest first
+	TArray<int32> m_PrimaryParentIndexs; // first parent of every class, -1 for root
+	TArray<int32> m_ClassIds; // preorder index in the primary parent tree
+	TArray<int32> m_ClassIdEnds; // one past the last class id of the subtree
 };
 
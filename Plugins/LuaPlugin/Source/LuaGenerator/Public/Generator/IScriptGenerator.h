@@ -17,7 +17,10 @@ public:
 	virtual FString GetClassName() const = 0;
 	virtual FString GetFileName() const ;
 	virtual FString GetRegName() const ;
-	virtual void GetParentNames(TArray<FString> &OutParentNames) const ;
+	virtual FString GetPropertyGetterRegName() const ;
+	virtual FString GetPropertySetterRegName() const ;
+	virtual void GetParentNames(TArray<FString> &OutParentNames) const ; // config inheritance
+	virtual FString GetTypeParentName() const ; // parent in the class id tree of the userdata type check
 
 public:
 	virtual FString GetFileHeader();
@@ -25,8 +28,13 @@ public:
 
 public:
 	NS_LuaGenerator::E_GeneratorType GetType() const { return m_eClassType; };
+	uint32 GetContentHash() const { return m_ContentHash; }
+
+protected:
+	bool SaveFileContent(const FString &FileContent, const FString &FilePathName);
 
 protected:
 	NS_LuaGenerator::E_GeneratorType m_eClassType;
 	FString m_OutDir;
+	uint32 m_ContentHash;
 };
@@ -15,6 +15,7 @@ public:
 	virtual void ExportToMemory() override;
 	virtual void SaveToFile() override;
 	virtual FString GetClassName() const override;
+	virtual FString GetTypeParentName() const override;
 
 public:
 	void ExportDataMembersToMemory();
@@ -18,6 +18,7 @@ public:
 	virtual void ExportToMemory() override;
 	virtual void SaveToFile() override;
 	virtual FString GetClassName() const override;
+	virtual FString GetTypeParentName() const override;
 
 private:
 	void ExportDataMemberToMemory();
@@ -33,6 +34,7 @@ private:
 private:
 	FExtraFuncMemberInfo GenerateNewExportFunction();
 	FExtraFuncMemberInfo GenerateDestoryExportFunction();
+	FExtraFuncMemberInfo GenerateMathOpExportFunction(const FString &FuncName, const FString &OpName);
 
 private:
 	UScriptStruct *m_pScriptStruct;
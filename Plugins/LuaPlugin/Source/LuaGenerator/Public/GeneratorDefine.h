@@ -67,6 +67,7 @@ namespace NS_LuaGenerator
 	bool StringBackContainSub(const FString &&SrcStr, const FString &&SubStr, int32 SrcTailIndex);
 	bool CanExportProperty(UProperty *InProperty);
 	bool CanExportFunction(UFunction *InFunction);
+	bool SaveFileIfChanged(const FString &FileContent, const FString &FilePathName);
 }
 
 
@@ -0,0 +1,30 @@
+#pragma once
+
+struct FGeneratorManifestEntry
+{
+	uint32 ContentHash;
+	TArray<FString> ParentNames; // sorted, a changed parent regenerates the class
+	TArray<FString> Dependencies; // sorted, classes whose properties registered the container
+};
+
+// what the last export wrote, kept next to the generated headers so the next UHT run
+// only regenerates classes that changed or depend on something that did
+class FGeneratorManifest
+{
+public:
+	FGeneratorManifest();
+
+public:
+	bool Load(const FString &FilePathName, uint32 InConfigHash);
+	bool Save(const FString &FilePathName) const;
+	void Reset(uint32 InConfigHash);
+
+	const FGeneratorManifestEntry* Find(const FString &Key) const { return m_Entries.Find(Key); }
+	void SetEntry(const FString &Key, const FGeneratorManifestEntry &Entry) { m_Entries.Add(Key, Entry); }
+	bool IsLoaded() const { return m_bLoaded; }
+
+private:
+	bool m_bLoaded;
+	uint32 m_ConfigHash;
+	TMap<FString, FGeneratorManifestEntry> m_Entries;
+};
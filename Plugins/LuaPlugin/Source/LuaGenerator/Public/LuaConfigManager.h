@@ -29,10 +29,14 @@ public:
 	FString ClassScriptHeaderSuffix;
 	FString LuaConfigFileRelativePath;
 	FString ClassConfigFileRelativeFolder;
+	// off by default, dependents only follow parents and container users, not the structs and classes used in
+	// property and function signatures. diff a clean export against an incremental one before turning it on
+	bool bIncrementalExport;
 
 	TArray<FString> SupportedModules;
 	TArray<FString> NotSuportClasses;
 	TArray<FString> SupportStructs;
+	TArray<FString> MathStructs;
 	TArray<FString> BaseTypes;
 	TArray<FString> ClassConfigFileNames;
 	TArray<FString> AdditionalIncludeHeaders;
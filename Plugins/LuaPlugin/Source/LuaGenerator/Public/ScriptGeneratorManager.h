@@ -3,6 +3,7 @@
 #include "IScriptGenerator.h"
 #include "ConfigClassDefine.h"
 #include "ClassParentsManager.h"
+#include "GeneratorManifest.h"
 
 class FScriptGeneratorManager
 {
@@ -36,12 +37,26 @@ private:
 
 private: // save to file
 	void SaveToFiles();
+	void SaveGeneratorsToFiles(const TArray<IScriptGenerator*> &Generators);
+
+private: // incremental export
+	uint32 GetConfigHash() const;
+	bool IsGeneratorDirty(IScriptGenerator *InGenerator);
+	bool DependsOnAny(IScriptGenerator *InGenerator, const TSet<FString> &Keys);
+	TArray<FString> GetSortedParentNames(const FString &ClassName);
+	void SaveManifest();
 
 private: // finish export post
 	void FinishExportPost();
-	void GenerateAndSaveAllHeaderFile();
+	void GenerateRegisterShardFiles();
 	void GererateLoadAllDefineFile();
 
+private: // register shards, each one compiled by LuaWrapper/Private/Shards/LuaRegisterShard<N>.cpp
+	static const int32 RegisterShardNum = 8;
+	FString GetRegisterShardName(int32 ShardIndex) const;
+	void GetRegisterShards(TArray<TArray<IScriptGenerator*>> &OutShards) const;
+	FString GetRegisterShardContent(int32 ShardIndex, const TArray<IScriptGenerator*> &Generators);
+
 private: // config class
 	void ExportConfigClasses();
 	void ExportConfigClass(const FConfigClass& ClassItem);
@@ -60,4 +75,11 @@ private:
 	TMap<FString, IScriptGenerator*> m_Generators;
 	FClassParentManager m_ClassParentManager;
 	TMap<FString, UProperty*> m_GeneratorPropertys;
+
+	FGeneratorManifest m_Manifest;
+	FString m_ExportingKey; // generator whose ExportToMemory is running, owner of the properties it registers
+	TSet<FString> m_ChangedKeys; // reported changed by UHT
+	TSet<FString> m_SavedKeys;
+	TMap<FString, TSet<FString>> m_GeneratorPropertyUsers;
+	TMap<FString, TArray<FString>> m_Dependencies; // container generator -> classes using it
 };
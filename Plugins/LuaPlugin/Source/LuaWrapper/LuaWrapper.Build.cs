@@ -8,6 +8,8 @@ public class LuaWrapper : ModuleRules
     public LuaWrapper(ReadOnlyTargetRules Target) : base(Target)
 	{
 		PCHUsage = ModuleRules.PCHUsageMode.UseExplicitOrSharedPCHs;
+		// the generated register shards are split to be compiled in parallel, unity files would merge them again
+		bFasterWithoutUnity = true;
 		
 		PublicIncludePaths.AddRange(
 			new string[] {
@@ -0,0 +1,224 @@
+#include "LuaAllocator.h"
+#include "HAL/IConsoleManager.h"
+
+// picked for 64 bit lua 5.1: short strings, userdata headers, closures with few upvalues, tables
+static const int32 SizeClassSizes[FLuaAllocator::SizeClassNum] = { 16, 24, 32, 48, 64, 80, 96, 112, 128, 160, 192, 256 };
+static const int32 MaxSmallSize = 256;
+static const int32 PageSize = 16 * 1024;
+
+struct FLuaSizeClassTable
+{ // size in 8 byte steps to size class
+	FLuaSizeClassTable()
+	{
+		int32 SizeClass = 0;
+		for (int32 i = 0; i < ARRAY_COUNT(SizeClasses); ++i)
+		{
+			while (SizeClassSizes[SizeClass] < i * 8)
+			{
+				++SizeClass;
+			}
+			SizeClasses[i] = SizeClass;
+		}
+	}
+
+	uint8 SizeClasses[MaxSmallSize / 8 + 1];
+};
+
+static const FLuaSizeClassTable SizeClassTable;
+
+static FORCEINLINE int32 GetSizeClass(size_t Size)
+{
+	return Size <= MaxSmallSize ? SizeClassTable.SizeClasses[(Size + 7) / 8] : INDEX_NONE;
+}
+
+FLuaAllocator::FLuaAllocator()
+{
+	FMemory::Memzero(m_FreeLists, sizeof(m_FreeLists));
+	FMemory::Memzero(&m_Stats, sizeof(m_Stats));
+}
+
+FLuaAllocator::~FLuaAllocator()
+{ // lua_close has freed every block already
+	for (void *pPage : m_Pages)
+	{
+		FMemory::Free(pPage);
+	}
+}
+
+void* FLuaAllocator::LuaAlloc(void *pUserData, void *ptr, size_t OldSize, size_t NewSize)
+{
+	FLuaAllocator *pAllocator = static_cast<FLuaAllocator*>(pUserData);
+	if (NewSize == 0)
+	{
+		if (ptr)
+		{
+			pAllocator->Free(ptr, OldSize);
+		}
+		return nullptr;
+	}
+
+	return ptr ? pAllocator->Realloc(ptr, OldSize, NewSize) : pAllocator->Alloc(NewSize);
+}
+
+int32 FLuaAllocator::GetSizeClassSize(int32 SizeClass)
+{
+	return SizeClassSizes[SizeClass];
+}
+
+void* FLuaAllocator::Alloc(size_t Size)
+{
+	m_Stats.TotalBytes += Size;
+	int32 SizeClass = GetSizeClass(Size);
+	if (SizeClass == INDEX_NONE)
+	{
+		m_Stats.LargeBytes += Size;
+		++m_Stats.LargeBlocks;
+		return FMemory::Malloc(Size);
+	}
+
+	if (!m_FreeLists[SizeClass])
+	{
+		AllocPage(SizeClass);
+	}
+
+	FFreeBlock *pBlock = m_FreeLists[SizeClass];
+	m_FreeLists[SizeClass] = pBlock->pNext;
+	++m_Stats.LiveBlocks[SizeClass];
+	--m_Stats.FreeBlocks[SizeClass];
+	return pBlock;
+}
+
+void FLuaAllocator::Free(void *ptr, size_t Size)
+{
+	m_Stats.TotalBytes -= Size;
+	int32 SizeClass = GetSizeClass(Size);
+	if (SizeClass == INDEX_NONE)
+	{
+		m_Stats.LargeBytes -= Size;
+		--m_Stats.LargeBlocks;
+		FMemory::Free(ptr);
+		return;
+	}
+
+	FFreeBlock *pBlock = static_cast<FFreeBlock*>(ptr);
+	pBlock->pNext = m_FreeLists[SizeClass];
+	m_FreeLists[SizeClass] = pBlock;
+	--m_Stats.LiveBlocks[SizeClass];
+	++m_Stats.FreeBlocks[SizeClass];
+}
+
+void* FLuaAllocator::Realloc(void *ptr, size_t OldSize, size_t NewSize)
+{
+	int32 OldSizeClass = GetSizeClass(OldSize);
+	int32 NewSizeClass = GetSizeClass(NewSize);
+	if (OldSizeClass != INDEX_NONE && OldSizeClass == NewSizeClass)
+	{ // the block is big enough already
+		m_Stats.TotalBytes += (int64)NewSize - (int64)OldSize;
+		return ptr;
+	}
+
+	if (OldSizeClass == INDEX_NONE && NewSizeClass == INDEX_NONE)
+	{ // growing tables and strings buffers
+		void *pNewPtr = FMemory::Realloc(ptr, NewSize);
+		if (pNewPtr)
+		{
+			m_Stats.TotalBytes += (int64)NewSize - (int64)OldSize;
+			m_Stats.LargeBytes += (int64)NewSize - (int64)OldSize;
+		}
+		return pNewPtr;
+	}
+
+	void *pNewPtr = Alloc(NewSize);
+	if (pNewPtr)
+	{
+		FMemory::Memcpy(pNewPtr, ptr, FMath::Min(OldSize, NewSize));
+		Free(ptr, OldSize);
+	}
+	return pNewPtr;
+}
+
+void FLuaAllocator::AllocPage(int32 SizeClass)
+{ // pages stay with the allocator until the lua state is closed
+	int32 BlockSize = SizeClassSizes[SizeClass];
+	int32 BlockNum = PageSize / BlockSize;
+	uint8 *pPage = static_cast<uint8*>(FMemory::Malloc(PageSize, 16));
+	m_Pages.Add(pPage);
+	m_Stats.PageBytes += PageSize;
+
+	for (int32 i = BlockNum - 1; i >= 0; --i)
+	{
+		FFreeBlock *pBlock = reinterpret_cast<FFreeBlock*>(pPage + i * BlockSize);
+		pBlock->pNext = m_FreeLists[SizeClass];
+		m_FreeLists[SizeClass] = pBlock;
+	}
+	m_Stats.FreeBlocks[SizeClass] += BlockNum;
+}
+
+void FLuaAllocator::LogStats() const
+{
+	LuaWrapperLog(Log, TEXT("FLuaAllocator: total %lld bytes, pages %lld bytes, large %d blocks %lld bytes"), m_Stats.TotalBytes, m_Stats.PageBytes, m_Stats.LargeBlocks, m_Stats.LargeBytes);
+	for (int32 i = 0; i < SizeClassNum; ++i)
+	{
+		LuaWrapperLog(Log, TEXT("    %3d bytes: %d live, %d free"), SizeClassSizes[i], m_Stats.LiveBlocks[i], m_Stats.FreeBlocks[i]);
+	}
+}
+
+static int32 LuaGetMemoryStats(lua_State *InLuaState)
+{
+	void *pUserData = nullptr;
+	if (lua_getallocf(InLuaState, &pUserData) != FLuaAllocator::LuaAlloc)
+	{
+		return 0;
+	}
+
+	const FLuaAllocator::FStats &Stats = static_cast<FLuaAllocator*>(pUserData)->GetStats();
+	lua_createtable(InLuaState, 0, 5);
+	lua_pushnumber(InLuaState, (lua_Number)Stats.TotalBytes);
+	lua_setfield(InLuaState, -2, "TotalBytes");
+	lua_pushnumber(InLuaState, (lua_Number)Stats.PageBytes);
+	lua_setfield(InLuaState, -2, "PageBytes");
+	lua_pushnumber(InLuaState, (lua_Number)Stats.LargeBytes);
+	lua_setfield(InLuaState, -2, "LargeBytes");
+	lua_pushinteger(InLuaState, Stats.LargeBlocks);
+	lua_setfield(InLuaState, -2, "LargeBlocks");
+
+	lua_createtable(InLuaState, FLuaAllocator::SizeClassNum, 0);
+	for (int32 i = 0; i < FLuaAllocator::SizeClassNum; ++i)
+	{
+		lua_createtable(InLuaState, 0, 3);
+		lua_pushinteger(InLuaState, SizeClassSizes[i]);
+		lua_setfield(InLuaState, -2, "Size");
+		lua_pushinteger(InLuaState, Stats.LiveBlocks[i]);
+		lua_setfield(InLuaState, -2, "LiveBlocks");
+		lua_pushinteger(InLuaState, Stats.FreeBlocks[i]);
+		lua_setfield(InLuaState, -2, "FreeBlocks");
+		lua_rawseti(InLuaState, -2, i + 1);
+	}
+	lua_setfield(InLuaState, -2, "SizeClasses");
+	return 1;
+}
+
+static const luaL_Reg LuaMemoryLib[] =
+{
+	{ "GetStats", LuaGetMemoryStats },
+	{ NULL, NULL }
+};
+
+void FLuaAllocator::RegisterStats(lua_State *InLuaState)
+{
+	luaL_register(InLuaState, "LuaMemory", LuaMemoryLib);
+	lua_pop(InLuaState, 1);
+}
+
+static void LogLuaMemoryStats()
+{
+	if (g_LuaAllocator)
+	{
+		g_LuaAllocator->LogStats();
+	}
+}
+
+static FAutoConsoleCommand LuaMemoryStatsCommand(
+	TEXT("Lua.MemoryStats"),
+	TEXT("Log the block usage of the lua allocator"),
+	FConsoleCommandDelegate::CreateStatic(LogLuaMemoryStats));
@@ -0,0 +1,252 @@
+#include "LuaUtil.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/App.h"
+#include "Misc/Paths.h"
+#include "Misc/FileHelper.h"
+#include "Misc/ConfigCacheIni.h"
+#include "SimpleTest.h"
+
+#if !UE_BUILD_SHIPPING
+
+// lua side of the benchmarks, every case runs its operation N times,
+// the empty loop is subtracted from the others
+static const char *LuaBenchSource =
+	"function LuaBench_Empty(a, b) end\n"
+	"function LuaBench_Add(a, b) return a + b end\n"
+	"LuaBench_Cases = {}\n"
+	"function LuaBench_Cases.Loop(N) for i = 1, N do end end\n"
+	"function LuaBench_Cases.GetProperty(N) local s = FBaseStruct1.New() local v for i = 1, N do v = s.m_Value1 end end\n"
+	"function LuaBench_Cases.SetProperty(N) local s = FBaseStruct1.New() for i = 1, N do s.m_Value1 = i end end\n"
+	"function LuaBench_Cases.GetManyProperties(N) local s = FBaseStruct1.New() local Names = { \"m_Value1\", \"m_Value2\", \"m_JustEnum\" } local Out = {} for i = 1, N do s:GetMany(Names, Out) end end\n"
+	"function LuaBench_Cases.SetManyProperties(N) local s = FBaseStruct1.New() local Values = { m_Value1 = 1, m_Value2 = 2, m_JustEnum = 0 } for i = 1, N do s:SetMany(Values) end end\n"
+	"function LuaBench_Cases.GetStructProperty(N) local s = FBaseStruct1.New() local v for i = 1, N do v = s.m_Struct end end\n"
+	"function LuaBench_Cases.NewStruct(N) local v for i = 1, N do v = FBaseStruct.New() end end\n"
+	"function LuaBench_Cases.ArrayAdd(N) local a = FBaseStruct1.New().m_BaseStructs local b = FBaseStruct.New() for i = 1, N do a:Add(b) end end\n"
+	"function LuaBench_Cases.ArrayGet(N) local a = FBaseStruct1.New().m_BaseStructs a:Add(FBaseStruct.New()) local v for i = 1, N do v = a:Get(0) end end\n"
+	"function LuaBench_Cases.MapFind(N) local m = FBaseStruct1.New().m_MapBaseStruct m:Add(1, FBaseStruct.New()) local v for i = 1, N do v = m:Find(1) end end\n";
+
+static const char *LuaBenchCases[] =
+{
+	"GetProperty",
+	"SetProperty",
+	"GetManyProperties",
+	"SetManyProperties",
+	"GetStructProperty",
+	"NewStruct",
+	"ArrayAdd",
+	"ArrayGet",
+	"MapFind",
+};
+
+typedef TArray<TPair<FString, double>> FLuaBenchResults; // case name, ns/op
+
+static void LogBenchResult(FLuaBenchResults &Results, const char *Name, double Seconds, int32 Iterations)
+{
+	double Nanoseconds = Seconds * 1000000000.0 / Iterations;
+	Results.Add(TPair<FString, double>(UTF8_TO_TCHAR(Name), Nanoseconds));
+	LuaWrapperLog(Log, TEXT("    %-20s %10.1f ns/op"), UTF8_TO_TCHAR(Name), Nanoseconds);
+}
+
+static FString GetBenchBaselinePath()
+{
+	return FPaths::GameConfigDir() / TEXT("LuaBenchBaseline.txt");
+}
+
+static void SaveBenchBaseline(const FLuaBenchResults &Results)
+{
+	FString Contents = TEXT("; Lua.Bench ns/op, written by Lua.Bench [Iterations] SaveBaseline on the machine the runs are compared on\n");
+	for (const TPair<FString, double> &Result : Results)
+	{
+		Contents += FString::Printf(TEXT("%s=%.1f\n"), *Result.Key, Result.Value);
+	}
+
+	if (FFileHelper::SaveStringToFile(Contents, *GetBenchBaselinePath()))
+	{
+		LuaWrapperLog(Log, TEXT("Lua.Bench: saved %s"), *GetBenchBaselinePath());
+	}
+	else
+	{
+		LuaWrapperLog(Error, TEXT("Lua.Bench: failed to save %s"), *GetBenchBaselinePath());
+	}
+}
+
+static int32 CompareBenchBaseline(const FLuaBenchResults &Results)
+{ // the number of cases slower than [LuaWrapper] BenchMaxRatio times their baseline
+	TArray<FString> Lines;
+	if (!FFileHelper::LoadFileToStringArray(Lines, *GetBenchBaselinePath()))
+	{
+		LuaWrapperLog(Warning, TEXT("Lua.Bench: no baseline at %s"), *GetBenchBaselinePath());
+		return 0;
+	}
+
+	TMap<FString, double> Baseline;
+	for (const FString &Line : Lines)
+	{
+		FString Name;
+		FString Value;
+		if (!Line.StartsWith(TEXT(";")) && Line.Split(TEXT("="), &Name, &Value))
+		{
+			Baseline.Add(Name, FCString::Atod(*Value));
+		}
+	}
+
+	float MaxRatio = 1.5f;
+	GConfig->GetFloat(TEXT("LuaWrapper"), TEXT("BenchMaxRatio"), MaxRatio, GGameIni);
+
+	int32 FailedNum = 0;
+	for (const TPair<FString, double> &Result : Results)
+	{
+		const double *pBaseline = Baseline.Find(Result.Key);
+		if (!pBaseline || *pBaseline <= 0.0)
+		{
+			LuaWrapperLog(Warning, TEXT("    %-20s no baseline"), *Result.Key);
+		}
+		else if (Result.Value > *pBaseline * MaxRatio)
+		{
+			LuaWrapperLog(Error, TEXT("    %-20s %10.1f ns/op, baseline %.1f, %.2fx > %.2fx"), *Result.Key, Result.Value, *pBaseline, Result.Value / *pBaseline, MaxRatio);
+			++FailedNum;
+		}
+	}
+
+	for (const TPair<FString, double> &Entry : Baseline)
+	{ // a case that raised an error has no result
+		if (!Results.ContainsByPredicate([&Entry](const TPair<FString, double> &Result) { return Result.Key == Entry.Key; }))
+		{
+			LuaWrapperLog(Error, TEXT("    %-20s no result"), *Entry.Key);
+			++FailedNum;
+		}
+	}
+	return FailedNum;
+}
+
+static double RunLuaBenchCase(lua_State *InLuaState, const char *Name, int32 Iterations)
+{
+	lua_getglobal(InLuaState, "LuaBench_Cases");
+	lua_getfield(InLuaState, -1, Name);
+	lua_pushinteger(InLuaState, Iterations);
+	double StartTime = FPlatformTime::Seconds();
+	int32 Result = lua_pcall(InLuaState, 1, 0, 0);
+	double Seconds = FPlatformTime::Seconds() - StartTime;
+	if (Result != 0)
+	{
+		LuaWrapperLog(Warning, TEXT("    %-20s %s"), UTF8_TO_TCHAR(Name), UTF8_TO_TCHAR(lua_tostring(InLuaState, -1)));
+		Seconds = -1.0;
+		lua_pop(InLuaState, 1);
+	}
+	lua_pop(InLuaState, 1);
+	return Seconds;
+}
+
+static double RunPushObjects(lua_State *InLuaState, TArray<FBaseStruct> &Structs)
+{ // the userdata cache is keyed by address, new addresses miss and pushed ones hit
+	double StartTime = FPlatformTime::Seconds();
+	for (FBaseStruct &Struct : Structs)
+	{
+		FBaseStruct *pStruct = &Struct;
+		FLuaUtil::Push(InLuaState, FLuaClassType<FBaseStruct*>(pStruct, "FBaseStruct"));
+		lua_pop(InLuaState, 1);
+	}
+	return FPlatformTime::Seconds() - StartTime;
+}
+
+static void RunLuaBench(const TArray<FString> &Args)
+{
+	lua_State *pLuaState = g_LuaState;
+	if (!pLuaState)
+	{
+		return;
+	}
+
+	int32 Iterations = 100000;
+	bool bSaveBaseline = false;
+	for (const FString &Arg : Args)
+	{
+		if (Arg == TEXT("SaveBaseline"))
+		{
+			bSaveBaseline = true;
+		}
+		else
+		{
+			Iterations = FMath::Max(FCString::Atoi(*Arg), 1);
+		}
+	}
+
+	if (luaL_dostring(pLuaState, LuaBenchSource) != 0)
+	{
+		LuaWrapperLog(Error, TEXT("Lua.Bench: %s"), UTF8_TO_TCHAR(lua_tostring(pLuaState, -1)));
+		lua_pop(pLuaState, 1);
+		return;
+	}
+
+	// collections in the middle would measure the collector and drop cached userdatas
+	lua_gc(pLuaState, LUA_GCCOLLECT, 0);
+	lua_gc(pLuaState, LUA_GCSTOP, 0);
+	LuaWrapperLog(Log, TEXT("Lua.Bench: %d iterations"), Iterations);
+
+	FLuaBenchResults Results;
+	double StartTime = FPlatformTime::Seconds();
+	for (int32 i = 0; i < Iterations; ++i)
+	{
+		FLuaUtil::Call("LuaBench_Empty", 1, 2.0f);
+	}
+	LogBenchResult(Results, "Call", FPlatformTime::Seconds() - StartTime, Iterations);
+
+	StartTime = FPlatformTime::Seconds();
+	for (int32 i = 0; i < Iterations; ++i)
+	{
+		int32 Result = 0;
+		FLuaUtil::CallR(Result, FLuaFuncName("LuaBench_Add"), i, 1);
+	}
+	LogBenchResult(Results, "CallR", FPlatformTime::Seconds() - StartTime, Iterations);
+
+	FLuaFunctionRef EmptyFunc("LuaBench_Empty");
+	StartTime = FPlatformTime::Seconds();
+	for (int32 i = 0; i < Iterations; ++i)
+	{
+		FLuaUtil::Call(EmptyFunc, 1, 2.0f);
+	}
+	LogBenchResult(Results, "CallFunctionRef", FPlatformTime::Seconds() - StartTime, Iterations);
+
+	double LoopSeconds = FMath::Max(RunLuaBenchCase(pLuaState, "Loop", Iterations), 0.0);
+	for (const char *Name : LuaBenchCases)
+	{
+		double Seconds = RunLuaBenchCase(pLuaState, Name, Iterations);
+		if (Seconds >= 0.0)
+		{
+			LogBenchResult(Results, Name, FMath::Max(Seconds - LoopSeconds, 0.0), Iterations);
+		}
+	}
+
+	TArray<FBaseStruct> Structs;
+	Structs.SetNumZeroed(Iterations);
+	LogBenchResult(Results, "PushObjectMiss", RunPushObjects(pLuaState, Structs), Iterations);
+	LogBenchResult(Results, "PushObjectHit", RunPushObjects(pLuaState, Structs), Iterations);
+
+	// the cached userdatas point into Structs
+	lua_gc(pLuaState, LUA_GCRESTART, 0);
+	lua_gc(pLuaState, LUA_GCCOLLECT, 0);
+
+	if (bSaveBaseline)
+	{
+		SaveBenchBaseline(Results);
+		return;
+	}
+
+	int32 FailedNum = CompareBenchBaseline(Results);
+	if (FailedNum > 0)
+	{
+		LuaWrapperLog(Error, TEXT("Lua.Bench: %d cases slower than the baseline"), FailedNum);
+		if (FApp::IsUnattended())
+		{ // -ExecCmds runs in automation end here with exit code 3
+			GIsCriticalError = true;
+			FPlatformMisc::RequestExit(true);
+		}
+	}
+}
+
+static FAutoConsoleCommand LuaBenchCommand(
+	TEXT("Lua.Bench"),
+	TEXT("Measure the cost of the generated bindings in ns/op and compare with Config/LuaBenchBaseline.txt, Lua.Bench [Iterations] [SaveBaseline]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(RunLuaBench));
+
+#endif
@@ -0,0 +1,142 @@
+#include "LuaGCScheduler.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/ConfigCacheIni.h"
+
+static const int32 MinPause = 110;
+static const int32 MaxPause = 300;
+static const int32 MinStepMul = 50;
+static const int32 MaxStepMul = 1000;
+static const int32 SafetyPauseExtra = 100; // lua's own pause, only reached if the ticks can't keep up
+static const int32 TargetCycleFrames = 30;
+static const float FallBehindRatio = 4.0f;
+
+FLuaGCScheduler::FLuaGCScheduler(lua_State *InLuaState)
+	: m_pLuaState(InLuaState)
+	, m_bInCycle(false)
+	, m_CycleFrames(0)
+{
+	int32 BudgetMicroseconds = 1000;
+	GConfig->GetInt(TEXT("LuaWrapper"), TEXT("GCBudgetMicroseconds"), BudgetMicroseconds, GGameIni);
+	m_BudgetSeconds = BudgetMicroseconds / 1000000.0;
+
+	FMemory::Memzero(&m_Stats, sizeof(m_Stats));
+	m_Stats.Pause = 200;
+	m_Stats.StepMul = 200;
+	lua_gc(m_pLuaState, LUA_GCSETPAUSE, m_Stats.Pause + SafetyPauseExtra);
+	lua_gc(m_pLuaState, LUA_GCSETSTEPMUL, m_Stats.StepMul);
+	m_EstimateKB = m_LastCountKB = lua_gc(m_pLuaState, LUA_GCCOUNT, 0);
+
+	m_TickHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FLuaGCScheduler::Tick));
+}
+
+FLuaGCScheduler::~FLuaGCScheduler()
+{
+	FTicker::GetCoreTicker().RemoveTicker(m_TickHandle);
+}
+
+bool FLuaGCScheduler::Tick(float DeltaTime)
+{
+	int32 CountKB = lua_gc(m_pLuaState, LUA_GCCOUNT, 0);
+	if (DeltaTime > 0.0f)
+	{ // nothing collects between ticks, so the growth is what the scripts allocated
+		float AllocKBPerSecond = FMath::Max(CountKB - m_LastCountKB, 0) / DeltaTime;
+		m_Stats.AllocKBPerSecond = FMath::Lerp(m_Stats.AllocKBPerSecond, AllocKBPerSecond, 0.1f);
+	}
+
+	if (!m_bInCycle && CountKB >= m_EstimateKB * m_Stats.Pause / 100)
+	{
+		m_bInCycle = true;
+		m_CycleFrames = 0;
+	}
+
+	if (m_bInCycle)
+	{ // far behind the scripts, finish the cycle now rather than run out of memory
+		bool bFallBehind = CountKB > m_EstimateKB * FallBehindRatio && m_CycleFrames > TargetCycleFrames;
+		if (bFallBehind)
+		{
+			LuaWrapperLog(Warning, TEXT("FLuaGCScheduler: %d KB after %d frames, finishing the cycle"), CountKB, m_CycleFrames);
+		}
+		RunSteps(DeltaTime, bFallBehind);
+	}
+
+	m_LastCountKB = lua_gc(m_pLuaState, LUA_GCCOUNT, 0);
+	return true;
+}
+
+void FLuaGCScheduler::RunSteps(float DeltaTime, bool bUntilFinished)
+{
+	double StartTime = FPlatformTime::Seconds();
+	double Elapsed = 0.0;
+	int32 StepNum = 0;
+	++m_CycleFrames;
+	while (bUntilFinished || Elapsed < m_BudgetSeconds)
+	{
+		++StepNum;
+		bool bFinished = lua_gc(m_pLuaState, LUA_GCSTEP, 0) != 0;
+		Elapsed = FPlatformTime::Seconds() - StartTime;
+		if (bFinished)
+		{
+			m_bInCycle = false;
+			m_EstimateKB = FMath::Max(lua_gc(m_pLuaState, LUA_GCCOUNT, 0), 1);
+			++m_Stats.Cycles;
+			TuneAfterCycle(DeltaTime);
+			break;
+		}
+	}
+
+	if (m_bInCycle)
+	{ // no allocation driven steps until the next tick, a finished cycle leaves lua's own threshold as a safety net
+		lua_gc(m_pLuaState, LUA_GCSTOP, 0);
+	}
+
+	// one step should take a small slice of the budget, so the last one doesn't overrun it much
+	double StepSeconds = Elapsed / StepNum;
+	if (!bUntilFinished && StepSeconds > m_BudgetSeconds / 4)
+	{
+		m_Stats.StepMul = FMath::Max(m_Stats.StepMul * 3 / 4, MinStepMul);
+	}
+	else if (StepNum > 16 && m_bInCycle)
+	{
+		m_Stats.StepMul = FMath::Min(m_Stats.StepMul * 5 / 4, MaxStepMul);
+	}
+	lua_gc(m_pLuaState, LUA_GCSETSTEPMUL, m_Stats.StepMul);
+
+	m_Stats.LastFrameMicroseconds = (int32)(Elapsed * 1000000.0);
+	m_Stats.MaxFrameMicroseconds = FMath::Max(m_Stats.MaxFrameMicroseconds, m_Stats.LastFrameMicroseconds);
+	m_Stats.TotalMicroseconds += Elapsed * 1000000.0;
+	++m_Stats.SteppedFrames;
+}
+
+void FLuaGCScheduler::TuneAfterCycle(float DeltaTime)
+{ // start the next cycle about when the scripts allocated what one cycle could collect at the current rate
+	float CycleAllocKB = m_Stats.AllocKBPerSecond * FMath::Max(DeltaTime, 0.001f) * FMath::Max(m_CycleFrames, TargetCycleFrames);
+	int32 Pause = 100 + (int32)(100.0f * CycleAllocKB / m_EstimateKB);
+	if (m_CycleFrames > TargetCycleFrames)
+	{ // the cycle ran long, start earlier
+		Pause = FMath::Min(Pause, m_Stats.Pause - 10);
+	}
+
+	m_Stats.Pause = FMath::Clamp(Pause, MinPause, MaxPause);
+	lua_gc(m_pLuaState, LUA_GCSETPAUSE, m_Stats.Pause + SafetyPauseExtra);
+}
+
+void FLuaGCScheduler::LogStats() const
+{
+	LuaWrapperLog(Log, TEXT("FLuaGCScheduler: %d cycles, last %d us, max %d us, avg %.1f us over %d frames, alloc %.1f KB/s, pause %d, stepmul %d"),
+		m_Stats.Cycles, m_Stats.LastFrameMicroseconds, m_Stats.MaxFrameMicroseconds,
+		m_Stats.SteppedFrames ? m_Stats.TotalMicroseconds / m_Stats.SteppedFrames : 0.0, m_Stats.SteppedFrames,
+		m_Stats.AllocKBPerSecond, m_Stats.Pause, m_Stats.StepMul);
+}
+
+static void LogLuaGCStats()
+{
+	if (g_LuaGCScheduler)
+	{
+		g_LuaGCScheduler->LogStats();
+	}
+}
+
+static FAutoConsoleCommand LuaGCStatsCommand(
+	TEXT("Lua.GCStats"),
+	TEXT("Log the pause times and tuning of the lua gc scheduler"),
+	FConsoleCommandDelegate::CreateStatic(LogLuaGCStats));
@@ -0,0 +1,45 @@
+#pragma once
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+#include "LuaWrapperDefine.h"
+
+// steps the lua collector from the core ticker within a time budget per frame,
+// instead of letting allocations trigger the steps in the middle of gameplay code
+class FLuaGCScheduler
+{
+public:
+	struct FStats
+	{
+		int32 Cycles;
+		int32 LastFrameMicroseconds;
+		int32 MaxFrameMicroseconds;
+		double TotalMicroseconds;
+		int32 SteppedFrames;
+		float AllocKBPerSecond;
+		int32 Pause;
+		int32 StepMul;
+	};
+
+public:
+	FLuaGCScheduler(lua_State *InLuaState);
+	~FLuaGCScheduler();
+
+public:
+	const FStats& GetStats() const { return m_Stats; }
+	void LogStats() const;
+
+private:
+	bool Tick(float DeltaTime);
+	void RunSteps(float DeltaTime, bool bUntilFinished);
+	void TuneAfterCycle(float DeltaTime);
+
+private:
+	lua_State *m_pLuaState;
+	FDelegateHandle m_TickHandle;
+	double m_BudgetSeconds;
+	bool m_bInCycle;
+	int32 m_CycleFrames;
+	int32 m_EstimateKB; // heap left by the last cycle
+	int32 m_LastCountKB;
+	FStats m_Stats;
+};
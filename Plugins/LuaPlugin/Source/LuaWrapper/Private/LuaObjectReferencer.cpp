@@ -0,0 +1,44 @@
+#include "LuaObjectReferencer.h"
+#include "LuaUtil.h"
+
+FLuaObjectReferencer::FLuaObjectReferencer()
+{
+
+}
+
+FLuaObjectReferencer::~FLuaObjectReferencer()
+{
+
+}
+
+void FLuaObjectReferencer::AddUserData(FLuaUserData *pUserData)
+{
+	pUserData->ReferenceIndex = m_UserDatas.Add(pUserData);
+}
+
+void FLuaObjectReferencer::RemoveUserData(FLuaUserData *pUserData)
+{ // swap the last one into the hole
+	int32 Index = pUserData->ReferenceIndex;
+	if (!m_UserDatas.IsValidIndex(Index) || m_UserDatas[Index] != pUserData)
+	{
+		return;
+	}
+
+	m_UserDatas.RemoveAtSwap(Index, 1, false);
+	if (Index < m_UserDatas.Num())
+	{
+		m_UserDatas[Index]->ReferenceIndex = Index;
+	}
+	pUserData->ReferenceIndex = INDEX_NONE;
+}
+
+void FLuaObjectReferencer::AddReferencedObjects(FReferenceCollector& Collector)
+{ // the collector nulls pObj of userdatas whose object is pending kill
+	for (FLuaUserData *pUserData : m_UserDatas)
+	{
+		if (pUserData->pObj)
+		{
+			Collector.AddReferencedObject(*reinterpret_cast<UObject**>(&pUserData->pObj));
+		}
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "CoreMinimal.h"
+#include "UObject/GCObject.h"
+
+struct FLuaUserData;
+
+// keeps the UObjects held by live lua userdatas alive, one per lua state
+class FLuaObjectReferencer : public FGCObject
+{
+public:
+	FLuaObjectReferencer();
+	virtual ~FLuaObjectReferencer();
+
+public:
+	void AddUserData(FLuaUserData *pUserData);
+	void RemoveUserData(FLuaUserData *pUserData);
+
+public:
+	/** FGCObject interface */
+	virtual void AddReferencedObjects(FReferenceCollector& Collector) override;
+
+private:
+	TArray<FLuaUserData*> m_UserDatas; // compact, every userdata knows its own index
+};
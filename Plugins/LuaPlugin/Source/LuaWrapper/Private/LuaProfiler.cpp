@@ -0,0 +1,357 @@
+#include "LuaProfiler.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+static const int32 MaxFrameHistory = 600;
+
+FLuaProfiler::FLuaProfiler(lua_State *InLuaState)
+	: m_pLuaState(InLuaState)
+	, m_bRunning(false)
+	, m_pStackThread(nullptr)
+	, m_pStack(nullptr)
+{
+
+}
+
+FLuaProfiler::~FLuaProfiler()
+{
+	Stop();
+}
+
+void FLuaProfiler::AddClassNames(lua_State *InLuaState, int32 MetatableIndex)
+{
+	lua_pushstring(InLuaState, "ClassName");
+	lua_rawget(InLuaState, MetatableIndex);
+	FString ClassName = lua_isstring(InLuaState, -1) ? UTF8_TO_TCHAR(lua_tostring(InLuaState, -1)) : TEXT("?");
+	lua_pop(InLuaState, 1);
+	AddFunctionNames(InLuaState, MetatableIndex, ClassName);
+}
+
+void FLuaProfiler::AddFunctionNames(lua_State *InLuaState, int32 TableIndex, const FString &ClassName)
+{
+	lua_pushnil(InLuaState);
+	while (lua_next(InLuaState, TableIndex))
+	{
+		if (lua_type(InLuaState, -2) == LUA_TSTRING && lua_iscfunction(InLuaState, -1))
+		{
+			const char *FuncName = lua_tostring(InLuaState, -2);
+			UPTRINT CFunction = (UPTRINT)lua_tocfunction(InLuaState, -1);
+			if (FuncName[0] == '_' && FuncName[1] == '_')
+			{
+				m_MetaMethodNames.Add(CFunction, UTF8_TO_TCHAR(FuncName));
+				if (lua_getupvalue(InLuaState, -1, 1))
+				{ // __index and __newindex hold the getters and setters, which they call directly
+					if (lua_istable(InLuaState, -1))
+					{
+						AddFunctionNames(InLuaState, lua_gettop(InLuaState), ClassName);
+					}
+					lua_pop(InLuaState, 1);
+				}
+			}
+			else
+			{
+				m_CFunctionNames.Add(CFunction, ClassName + TEXT(".") + UTF8_TO_TCHAR(FuncName));
+			}
+		}
+		lua_pop(InLuaState, 1);
+	}
+}
+
+void FLuaProfiler::Start()
+{
+	if (m_bRunning)
+	{
+		return;
+	}
+
+	m_Nodes.Reset();
+	m_Nodes.AddZeroed();
+	m_Nodes[0].Parent = INDEX_NONE;
+	m_Nodes[0].Name = TEXT("lua");
+	m_Stacks.Reset();
+	m_pStackThread = nullptr;
+	m_pStack = nullptr;
+	m_FrameMilliseconds.Reset();
+
+	// names are only needed while profiling, luaL_newmetatable keeps every class metatable in the registry
+	m_CFunctionNames.Reset();
+	m_MetaMethodNames.Reset();
+	lua_pushnil(m_pLuaState);
+	while (lua_next(m_pLuaState, LUA_REGISTRYINDEX))
+	{
+		if (lua_type(m_pLuaState, -2) == LUA_TSTRING && lua_istable(m_pLuaState, -1))
+		{
+			lua_pushstring(m_pLuaState, "IsCppClass");
+			lua_rawget(m_pLuaState, -2);
+			bool bCppClass = lua_toboolean(m_pLuaState, -1) != 0;
+			lua_pop(m_pLuaState, 1);
+			if (bCppClass)
+			{
+				AddClassNames(m_pLuaState, lua_gettop(m_pLuaState));
+			}
+		}
+		lua_pop(m_pLuaState, 1);
+	}
+
+	m_bRunning = true;
+	m_TickHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FLuaProfiler::Tick));
+	lua_sethook(m_pLuaState, HookFunc, LUA_MASKCALL | LUA_MASKRET, 0);
+}
+
+void FLuaProfiler::Stop()
+{
+	if (!m_bRunning)
+	{
+		return;
+	}
+
+	lua_sethook(m_pLuaState, nullptr, 0, 0);
+	FTicker::GetCoreTicker().RemoveTicker(m_TickHandle);
+	m_bRunning = false;
+}
+
+void FLuaProfiler::HookFunc(lua_State *InLuaState, lua_Debug *ar)
+{
+	if (!g_LuaProfiler)
+	{
+		return;
+	}
+
+	if (ar->event == LUA_HOOKCALL)
+	{
+		g_LuaProfiler->OnCall(InLuaState, ar);
+	}
+	else
+	{ // LUA_HOOKTAILRET closes the frames replaced by tail calls
+		g_LuaProfiler->OnReturn(InLuaState);
+	}
+}
+
+void FLuaProfiler::SwitchThread(lua_State *InLuaState)
+{ // a coroutine starting hangs its frames under whatever resumed it
+	int32 ResumerNode = m_pStack && m_pStack->Num() > 0 ? m_pStack->Last().Node : INDEX_NONE;
+	m_pStackThread = InLuaState;
+	m_pStack = &m_Stacks.FindOrAdd(InLuaState); // may move the other stacks
+	if (m_pStack->Num() == 0 && ResumerNode != INDEX_NONE)
+	{
+		FStackFrame Frame;
+		Frame.Node = ResumerNode;
+		Frame.StartCycles = 0; // never closed, only a parent
+		m_pStack->Add(Frame);
+	}
+}
+
+void FLuaProfiler::OnCall(lua_State *InLuaState, lua_Debug *ar)
+{
+	if (InLuaState != m_pStackThread)
+	{
+		SwitchThread(InLuaState);
+	}
+
+	FStackFrame Frame;
+	Frame.Node = GetChildNode(m_pStack->Num() > 0 ? m_pStack->Last().Node : 0, InLuaState, ar);
+	Frame.StartCycles = FPlatformTime::Cycles64();
+	m_pStack->Add(Frame);
+}
+
+void FLuaProfiler::OnReturn(lua_State *InLuaState)
+{
+	uint64 EndCycles = FPlatformTime::Cycles64();
+	if (InLuaState != m_pStackThread)
+	{
+		SwitchThread(InLuaState);
+	}
+
+	if (m_pStack->Num() == 0 || m_pStack->Last().StartCycles == 0)
+	{ // returning from a call made before Start
+		return;
+	}
+
+	FStackFrame Frame = m_pStack->Pop(false);
+	FNode &Node = m_Nodes[Frame.Node];
+	Node.TotalCycles += EndCycles - Frame.StartCycles;
+	Node.FrameCycles += EndCycles - Frame.StartCycles;
+	++Node.Calls;
+}
+
+int32 FLuaProfiler::GetChildNode(int32 Parent, lua_State *InLuaState, lua_Debug *ar)
+{
+	lua_getinfo(InLuaState, "Sf", ar);
+	bool bCFunction = ar->what[0] == 'C';
+	UPTRINT CFunction = bCFunction ? (UPTRINT)lua_tocfunction(InLuaState, -1) : 0;
+	const FString *pMetaMethodName = bCFunction ? m_MetaMethodNames.Find(CFunction) : nullptr;
+	// every class metatable holds its own closure of a meta method
+	uint64 Key = pMetaMethodName ? (uint64)(UPTRINT)lua_topointer(InLuaState, -1) : bCFunction ? (uint64)CFunction : (uint64)(UPTRINT)ar->source ^ ((uint64)ar->linedefined << 48);
+	lua_pop(InLuaState, 1);
+
+	if (int32 *pChild = m_Nodes[Parent].Children.Find(Key))
+	{
+		return *pChild;
+	}
+
+	// only a new call path pays for the name
+	FString Name;
+	const FString *pCFunctionName = bCFunction ? m_CFunctionNames.Find(CFunction) : nullptr;
+	if (pCFunctionName)
+	{
+		Name = *pCFunctionName;
+	}
+	else if (pMetaMethodName)
+	{ // the call hook runs in the frame of the meta method, 1 is the indexed object
+		FString ClassName = TEXT("?");
+		if (lua_getmetatable(InLuaState, 1))
+		{
+			lua_pushstring(InLuaState, "ClassName");
+			lua_rawget(InLuaState, -2);
+			if (lua_isstring(InLuaState, -1))
+			{
+				ClassName = UTF8_TO_TCHAR(lua_tostring(InLuaState, -1));
+			}
+			lua_pop(InLuaState, 2);
+		}
+		Name = FString::Printf(TEXT("%s.%s"), *ClassName, **pMetaMethodName);
+	}
+	else
+	{
+		lua_getinfo(InLuaState, "n", ar);
+		FString FuncName = ar->name ? UTF8_TO_TCHAR(ar->name) : (ar->what[0] == 'm' ? TEXT("main chunk") : TEXT("?"));
+		Name = bCFunction ? FuncName : FString::Printf(TEXT("%s (%s:%d)"), *FuncName, UTF8_TO_TCHAR(ar->short_src), ar->linedefined);
+	}
+	Name.ReplaceInline(TEXT(";"), TEXT(":"));
+
+	int32 Child = m_Nodes.AddZeroed();
+	m_Nodes[Child].Parent = Parent;
+	m_Nodes[Child].Name = MoveTemp(Name);
+	m_Nodes[Parent].Children.Add(Key, Child);
+	return Child;
+}
+
+bool FLuaProfiler::Tick(float DeltaTime)
+{ // lua is not running between frames, frames left on the main stack were unwound by errors
+	m_pStackThread = nullptr;
+	TArray<FStackFrame> *pMainStack = m_Stacks.Find(m_pLuaState);
+	if (pMainStack)
+	{
+		pMainStack->Reset();
+	}
+
+	uint64 FrameCycles = 0;
+	for (const TPair<uint64, int32> &Child : m_Nodes[0].Children)
+	{
+		FrameCycles += m_Nodes[Child.Value].FrameCycles;
+	}
+	for (FNode &Node : m_Nodes)
+	{
+		Node.FrameCycles = 0;
+	}
+
+	if (m_FrameMilliseconds.Num() >= MaxFrameHistory)
+	{
+		m_FrameMilliseconds.RemoveAt(0, 1, false);
+	}
+	m_FrameMilliseconds.Add(FPlatformTime::ToMilliseconds64(FrameCycles));
+	return true;
+}
+
+FString FLuaProfiler::GetNodePath(int32 Node) const
+{
+	FString Path = m_Nodes[Node].Name;
+	for (int32 Parent = m_Nodes[Node].Parent; Parent != INDEX_NONE; Parent = m_Nodes[Parent].Parent)
+	{
+		Path = m_Nodes[Parent].Name + TEXT(";") + Path;
+	}
+	return Path;
+}
+
+bool FLuaProfiler::DumpFolded(const FString &FilePath) const
+{
+	FString Contents;
+	for (int32 i = 1; i < m_Nodes.Num(); ++i)
+	{
+		const FNode &Node = m_Nodes[i];
+		uint64 SelfCycles = Node.TotalCycles;
+		for (const TPair<uint64, int32> &Child : Node.Children)
+		{
+			SelfCycles -= FMath::Min(SelfCycles, m_Nodes[Child.Value].TotalCycles);
+		}
+
+		int64 SelfMicroseconds = (int64)(FPlatformTime::ToMilliseconds64(SelfCycles) * 1000.0);
+		if (SelfMicroseconds > 0)
+		{
+			Contents += FString::Printf(TEXT("%s %lld\n"), *GetNodePath(i), SelfMicroseconds);
+		}
+	}
+	return FFileHelper::SaveStringToFile(Contents, *FilePath);
+}
+
+void FLuaProfiler::LogSummary() const
+{
+	float TotalMilliseconds = 0.0f;
+	float MaxMilliseconds = 0.0f;
+	for (float Milliseconds : m_FrameMilliseconds)
+	{
+		TotalMilliseconds += Milliseconds;
+		MaxMilliseconds = FMath::Max(MaxMilliseconds, Milliseconds);
+	}
+	LuaWrapperLog(Log, TEXT("FLuaProfiler: last %d frames, lua %.3f ms avg, %.3f ms max"), m_FrameMilliseconds.Num(),
+		m_FrameMilliseconds.Num() ? TotalMilliseconds / m_FrameMilliseconds.Num() : 0.0f, MaxMilliseconds);
+
+	TArray<int32> SortedNodes;
+	for (int32 i = 1; i < m_Nodes.Num(); ++i)
+	{
+		SortedNodes.Add(i);
+	}
+	SortedNodes.Sort([this](int32 A, int32 B) { return m_Nodes[A].TotalCycles > m_Nodes[B].TotalCycles; });
+	for (int32 i = 0; i < SortedNodes.Num() && i < 20; ++i)
+	{
+		const FNode &Node = m_Nodes[SortedNodes[i]];
+		LuaWrapperLog(Log, TEXT("    %10.3f ms %8d calls  %s"), FPlatformTime::ToMilliseconds64(Node.TotalCycles), Node.Calls, *GetNodePath(SortedNodes[i]));
+	}
+}
+
+static void LuaProfileStart()
+{
+	if (g_LuaProfiler)
+	{
+		g_LuaProfiler->Start();
+	}
+}
+
+static void LuaProfileStop()
+{
+	if (g_LuaProfiler && g_LuaProfiler->IsRunning())
+	{
+		g_LuaProfiler->Stop();
+		g_LuaProfiler->LogSummary();
+	}
+}
+
+static void LuaProfileDump(const TArray<FString> &Args)
+{
+	if (!g_LuaProfiler)
+	{
+		return;
+	}
+
+	FString FilePath = Args.Num() > 0 ? Args[0] : FPaths::ProfilingDir() / TEXT("Lua") / FString::Printf(TEXT("LuaProfile-%s.folded"), *FDateTime::Now().ToString());
+	if (g_LuaProfiler->DumpFolded(FilePath))
+	{
+		LuaWrapperLog(Log, TEXT("FLuaProfiler: dumped %s"), *FilePath);
+	}
+}
+
+static FAutoConsoleCommand LuaProfileStartCommand(
+	TEXT("Lua.Profile.Start"),
+	TEXT("Hook every lua call and start collecting the call tree"),
+	FConsoleCommandDelegate::CreateStatic(LuaProfileStart));
+
+static FAutoConsoleCommand LuaProfileStopCommand(
+	TEXT("Lua.Profile.Stop"),
+	TEXT("Remove the hook and log the per frame times and the most expensive call paths"),
+	FConsoleCommandDelegate::CreateStatic(LuaProfileStop));
+
+static FAutoConsoleCommand LuaProfileDumpCommand(
+	TEXT("Lua.Profile.Dump"),
+	TEXT("Write the call tree in folded stack format, Lua.Profile.Dump [FilePath]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(LuaProfileDump));
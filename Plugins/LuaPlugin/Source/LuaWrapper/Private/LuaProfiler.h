@@ -0,0 +1,60 @@
+#pragma once
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+#include "LuaWrapperDefine.h"
+
+// instrumenting profiler on the call/return hooks, builds a call tree with the time of every
+// lua function and bound C function, nothing is hooked until Start
+class FLuaProfiler
+{
+public:
+	FLuaProfiler(lua_State *InLuaState);
+	~FLuaProfiler();
+
+public:
+	void Start();
+	void Stop();
+	bool IsRunning() const { return m_bRunning; }
+	bool DumpFolded(const FString &FilePath) const; // one "a;b;c microseconds" line per call path, for flamegraph.pl
+	void LogSummary() const;
+	void AddClassNames(lua_State *InLuaState, int32 MetatableIndex); // a class registered while running, MetatableIndex absolute
+
+private:
+	struct FNode
+	{
+		int32 Parent;
+		FString Name;
+		TMap<uint64, int32> Children;
+		uint64 TotalCycles;
+		uint64 FrameCycles;
+		int32 Calls;
+	};
+
+	struct FStackFrame
+	{
+		int32 Node;
+		uint64 StartCycles;
+	};
+
+private:
+	static void HookFunc(lua_State *InLuaState, lua_Debug *ar);
+	void OnCall(lua_State *InLuaState, lua_Debug *ar);
+	void OnReturn(lua_State *InLuaState);
+	void SwitchThread(lua_State *InLuaState);
+	void AddFunctionNames(lua_State *InLuaState, int32 TableIndex, const FString &ClassName);
+	int32 GetChildNode(int32 Parent, lua_State *InLuaState, lua_Debug *ar);
+	FString GetNodePath(int32 Node) const;
+	bool Tick(float DeltaTime);
+
+private:
+	lua_State *m_pLuaState;
+	FDelegateHandle m_TickHandle;
+	bool m_bRunning;
+	TArray<FNode> m_Nodes; // 0 is the root
+	TMap<lua_State*, TArray<FStackFrame>> m_Stacks; // coroutines keep their own stack
+	lua_State *m_pStackThread;
+	TArray<FStackFrame> *m_pStack;
+	TArray<float> m_FrameMilliseconds;
+	TMap<UPTRINT, FString> m_CFunctionNames; // bound C functions by address, "Class.Func"
+	TMap<UPTRINT, FString> m_MetaMethodNames; // shared by every class, "Class.__index" takes the class from the metatable
+};
@@ -0,0 +1,202 @@
+#include "LuaScriptLoader.h"
+#include "LuaScriptPack.h"
+#include "Misc/Paths.h"
+#include "Misc/FileHelper.h"
+#include "Misc/SecureHash.h"
+#include "Misc/ConfigCacheIni.h"
+
+// cache file: sha1 of the source, then the lua_dump of the compiled chunk
+static const int32 SourceHashSize = 20;
+
+static int32 LuaDumpWriter(lua_State *InLuaState, const void *pData, size_t Size, void *pUserData)
+{
+	static_cast<TArray<uint8>*>(pUserData)->Append(static_cast<const uint8*>(pData), Size);
+	return 0;
+}
+
+void FLuaScriptLoader::InstallRequireLoader(lua_State *InLuaState)
+{ // before the default lua file searcher, so modules in LuaSource come from the cache
+	lua_getglobal(InLuaState, "package");
+	lua_getfield(InLuaState, -1, "loaders");
+	if (!lua_istable(InLuaState, -1))
+	{
+		lua_pop(InLuaState, 2);
+		LuaWrapperLog(Error, TEXT("InstallRequireLoader: package.loaders not found"));
+		return;
+	}
+
+	int32 LoaderNum = lua_objlen(InLuaState, -1);
+	for (int32 i = LoaderNum; i >= 2; --i)
+	{ // loaders[1] is the preload searcher, keep it first
+		lua_rawgeti(InLuaState, -1, i);
+		lua_rawseti(InLuaState, -2, i + 1);
+	}
+	lua_pushcfunction(InLuaState, RequireLoader);
+	lua_rawseti(InLuaState, -2, 2);
+	lua_pop(InLuaState, 2);
+}
+
+int32 FLuaScriptLoader::RequireLoader(lua_State *InLuaState)
+{
+	FString ModuleName = ANSI_TO_TCHAR(luaL_checkstring(InLuaState, 1));
+	FString FilePath = GetSourceDir() / ModuleName.Replace(TEXT("."), TEXT("/")) + TEXT(".lua");
+	const char *pChunk = nullptr;
+	int32 ChunkSize = 0;
+	bool bPacked = FindPackedChunk(FilePath, pChunk, ChunkSize);
+	if (!bPacked && !FPaths::FileExists(FilePath))
+	{
+		lua_pushfstring(InLuaState, "\n\tno file '%s'", TCHAR_TO_UTF8(*FilePath));
+		return 1;
+	}
+
+	if (LoadFile(InLuaState, FilePath, pChunk, ChunkSize) != 0)
+	{
+		return luaL_error(InLuaState, "error loading module '%s':\n\t%s", lua_tostring(InLuaState, 1), lua_tostring(InLuaState, -1));
+	}
+	return 1;
+}
+
+int32 FLuaScriptLoader::LoadFile(lua_State *InLuaState, const FString &FilePath)
+{
+	const char *pChunk = nullptr;
+	int32 ChunkSize = 0;
+	FindPackedChunk(FilePath, pChunk, ChunkSize);
+	return LoadFile(InLuaState, FilePath, pChunk, ChunkSize);
+}
+
+int32 FLuaScriptLoader::LoadFile(lua_State *InLuaState, const FString &FilePath, const char *pPackedChunk, int32 PackedChunkSize)
+{
+	FString ChunkName = FString(TEXT("@")) + FilePath;
+	if (pPackedChunk)
+	{
+		if (FLuaScriptPack::LoadChunk(InLuaState, pPackedChunk, PackedChunkSize, TCHAR_TO_UTF8(*ChunkName)) == 0)
+		{
+			return 0;
+		}
+
+		// a broken chunk, the loose file may still be there
+		LuaWrapperLog(Warning, TEXT("LoadFile: %s in the script pack, %s"), *FilePath, UTF8_TO_TCHAR(lua_tostring(InLuaState, -1)));
+		lua_pop(InLuaState, 1);
+	}
+
+	TArray<uint8> Source;
+	if (!FFileHelper::LoadFileToArray(Source, *FilePath))
+	{
+		lua_pushfstring(InLuaState, "cannot open %s", TCHAR_TO_UTF8(*FilePath));
+		return LUA_ERRFILE;
+	}
+
+	uint8 SourceHash[SourceHashSize];
+	FSHA1::HashBuffer(Source.GetData(), Source.Num(), SourceHash);
+
+	FString RelativePath = FilePath;
+	FPaths::MakePathRelativeTo(RelativePath, *(GetSourceDir() / TEXT("")));
+	FString CacheFilePath = GetCacheDir() / RelativePath + TEXT("c");
+
+	if (LoadCachedChunk(InLuaState, CacheFilePath, SourceHash, TCHAR_TO_UTF8(*ChunkName)))
+	{
+		return 0;
+	}
+
+	int32 Result = luaL_loadbuffer(InLuaState, reinterpret_cast<const char*>(Source.GetData()), Source.Num(), TCHAR_TO_UTF8(*ChunkName));
+	if (Result == 0)
+	{
+		SaveCachedChunk(InLuaState, CacheFilePath, SourceHash);
+	}
+	return Result;
+}
+
+bool FLuaScriptLoader::LoadCachedChunk(lua_State *InLuaState, const FString &CacheFilePath, const uint8 *SourceHash, const char *ChunkName)
+{
+	TArray<uint8> CacheData;
+	if (!FFileHelper::LoadFileToArray(CacheData, *CacheFilePath, FILEREAD_Silent) || CacheData.Num() <= SourceHashSize)
+	{
+		return false;
+	}
+
+	if (FMemory::Memcmp(CacheData.GetData(), SourceHash, SourceHashSize) != 0)
+	{ // source changed
+		return false;
+	}
+
+	if (luaL_loadbuffer(InLuaState, reinterpret_cast<const char*>(CacheData.GetData() + SourceHashSize), CacheData.Num() - SourceHashSize, ChunkName) != 0)
+	{ // bytecode from another lua build, compile the source again
+		LuaWrapperLog(Warning, TEXT("LoadCachedChunk: %s, %s"), *CacheFilePath, UTF8_TO_TCHAR(lua_tostring(InLuaState, -1)));
+		lua_pop(InLuaState, 1);
+		return false;
+	}
+	return true;
+}
+
+void FLuaScriptLoader::SaveCachedChunk(lua_State *InLuaState, const FString &CacheFilePath, const uint8 *SourceHash)
+{ // the compiled function is on the top of the stack
+	TArray<uint8> CacheData;
+	CacheData.Append(SourceHash, SourceHashSize);
+	if (lua_dump(InLuaState, LuaDumpWriter, &CacheData) != 0)
+	{
+		return;
+	}
+
+	if (!FFileHelper::SaveArrayToFile(CacheData, *CacheFilePath))
+	{
+		LuaWrapperLog(Warning, TEXT("SaveCachedChunk: failed to save %s"), *CacheFilePath);
+	}
+}
+
+const FLuaScriptPack& FLuaScriptLoader::GetScriptPack()
+{ // mapped once per process, restarting the lua state keeps the pages
+	static FLuaScriptPack ScriptPack;
+	static bool bMountTried = false;
+	if (!bMountTried)
+	{
+		bMountTried = true;
+		if (ScriptPack.Mount(FLuaScriptPack::GetDefaultPackPath()))
+		{
+			LuaWrapperLog(Log, TEXT("FLuaScriptLoader: mounted %s"), *FLuaScriptPack::GetDefaultPackPath());
+		}
+	}
+	return ScriptPack;
+}
+
+bool FLuaScriptLoader::ShouldUseScriptPack(const FString &FilePath)
+{ // cooked builds run from the pack. elsewhere only with [LuaWrapper] bUseScriptPack=True in DefaultGame.ini,
+  // and a loose file still wins so a stale pack never hides edits in LuaSource
+	static const bool bPackOnly = UE_BUILD_SHIPPING || FPlatformProperties::RequiresCookedData();
+	static bool bPackEnabled = false;
+	static bool bConfigRead = false;
+	if (!bConfigRead)
+	{
+		bConfigRead = true;
+		GConfig->GetBool(TEXT("LuaWrapper"), TEXT("bUseScriptPack"), bPackEnabled, GGameIni);
+	}
+
+	return bPackOnly || (bPackEnabled && !FPaths::FileExists(FilePath));
+}
+
+bool FLuaScriptLoader::FindPackedChunk(const FString &FilePath, const char *&OutChunk, int32 &OutChunkSize)
+{
+	FString PackedName;
+	return ShouldUseScriptPack(FilePath) && GetPackedName(FilePath, PackedName) && GetScriptPack().FindChunk(TCHAR_TO_UTF8(*PackedName), OutChunk, OutChunkSize);
+}
+
+bool FLuaScriptLoader::GetPackedName(const FString &FilePath, FString &OutName)
+{ // pack entries are named relative to LuaSource
+	FString SourceDir = GetSourceDir() / TEXT("");
+	if (!FilePath.StartsWith(SourceDir))
+	{
+		return false;
+	}
+
+	OutName = FilePath.Mid(SourceDir.Len());
+	return true;
+}
+
+FString FLuaScriptLoader::GetSourceDir()
+{
+	return FPaths::ConvertRelativePathToFull(FPaths::GameDir() / TEXT("LuaSource"));
+}
+
+FString FLuaScriptLoader::GetCacheDir()
+{
+	return FPaths::ConvertRelativePathToFull(FPaths::GameIntermediateDir() / TEXT("LuaCache"));
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "CoreMinimal.h"
+#include "LuaWrapperDefine.h"
+
+class FLuaScriptPack;
+
+// loads the scripts under LuaSource, from the script pack in cooked builds,
+// otherwise through a bytecode cache in Intermediate/LuaCache
+class FLuaScriptLoader
+{
+public:
+	static void InstallRequireLoader(lua_State *InLuaState);
+	static int32 LoadFile(lua_State *InLuaState, const FString &FilePath); // same result as luaL_loadfile
+
+public:
+	static FString GetSourceDir();
+	static FString GetCacheDir();
+
+private:
+	static int32 RequireLoader(lua_State *InLuaState);
+	static int32 LoadFile(lua_State *InLuaState, const FString &FilePath, const char *pPackedChunk, int32 PackedChunkSize); // pPackedChunk from FindPackedChunk, nullptr for the loose file
+	static bool FindPackedChunk(const FString &FilePath, const char *&OutChunk, int32 &OutChunkSize);
+	static const FLuaScriptPack& GetScriptPack();
+	static bool ShouldUseScriptPack(const FString &FilePath);
+	static bool GetPackedName(const FString &FilePath, FString &OutName);
+	static bool LoadCachedChunk(lua_State *InLuaState, const FString &CacheFilePath, const uint8 *SourceHash, const char *ChunkName);
+	static void SaveCachedChunk(lua_State *InLuaState, const FString &CacheFilePath, const uint8 *SourceHash);
+};
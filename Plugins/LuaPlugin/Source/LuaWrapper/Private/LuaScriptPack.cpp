@@ -0,0 +1,356 @@
+#include "LuaScriptPack.h"
+#include "Misc/Paths.h"
+#include "Misc/FileHelper.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#if WITH_EDITOR
+#include "GameDelegates.h"
+#endif
+
+#if PLATFORM_WINDOWS
+#include "WindowsHWrapper.h"
+#elif PLATFORM_LINUX || PLATFORM_MAC
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const uint32 LuaPackMagic = 0x4B50554C; // "LUPK"
+static const uint32 LuaPackVersion = 1;
+
+struct FLuaPackHeader
+{
+	uint32 Magic;
+	uint32 Version;
+	uint32 EntryNum;
+};
+
+struct FLuaPackEntry
+{
+	uint32 NameOffset; // from the start of the file, zero terminated
+	uint32 NameSize;
+	uint32 ChunkOffset;
+	uint32 ChunkSize;
+};
+
+struct FLuaPackReader
+{
+	const char *pChunk;
+	size_t ChunkSize;
+};
+
+static const char* LuaPackChunkReader(lua_State *InLuaState, void *pUserData, size_t *OutSize)
+{ // hands the mapped chunk to lua_load in one piece
+	FLuaPackReader *pReader = static_cast<FLuaPackReader*>(pUserData);
+	if (pReader->ChunkSize == 0)
+	{
+		return nullptr;
+	}
+
+	*OutSize = pReader->ChunkSize;
+	pReader->ChunkSize = 0;
+	return pReader->pChunk;
+}
+
+FLuaScriptPack::FLuaScriptPack()
+	: m_pData(nullptr)
+	, m_DataSize(0)
+	, m_pFileHandle(nullptr)
+	, m_pMappingHandle(nullptr)
+{
+
+}
+
+FLuaScriptPack::~FLuaScriptPack()
+{
+	Unmount();
+}
+
+bool FLuaScriptPack::Mount(const FString &PackFilePath)
+{
+	Unmount();
+
+#if PLATFORM_WINDOWS
+	HANDLE FileHandle = CreateFileW(*PackFilePath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (FileHandle == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER FileSize;
+	HANDLE MappingHandle = GetFileSizeEx(FileHandle, &FileSize) ? CreateFileMappingW(FileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+	if (MappingHandle == nullptr)
+	{
+		CloseHandle(FileHandle);
+		return false;
+	}
+
+	m_pFileHandle = FileHandle;
+	m_pMappingHandle = MappingHandle;
+	m_pData = static_cast<const uint8*>(MapViewOfFile(MappingHandle, FILE_MAP_READ, 0, 0, 0));
+	m_DataSize = FileSize.QuadPart;
+#elif PLATFORM_LINUX || PLATFORM_MAC
+	int FileHandle = open(TCHAR_TO_UTF8(*PackFilePath), O_RDONLY);
+	if (FileHandle < 0)
+	{
+		return false;
+	}
+
+	struct stat FileStat;
+	if (fstat(FileHandle, &FileStat) == 0 && FileStat.st_size > 0)
+	{
+		void *pMapped = mmap(nullptr, FileStat.st_size, PROT_READ, MAP_SHARED, FileHandle, 0);
+		if (pMapped != MAP_FAILED)
+		{
+			m_pData = static_cast<const uint8*>(pMapped);
+			m_DataSize = FileStat.st_size;
+		}
+	}
+	close(FileHandle); // the mapping keeps the file open
+#else
+	if (FFileHelper::LoadFileToArray(m_FallbackData, *PackFilePath, FILEREAD_Silent))
+	{
+		m_pData = m_FallbackData.GetData();
+		m_DataSize = m_FallbackData.Num();
+	}
+#endif
+
+	if (m_pData && !Validate())
+	{
+		LuaWrapperLog(Error, TEXT("FLuaScriptPack::Mount %s is not a valid lua pack"), *PackFilePath);
+		Unmount();
+	}
+	return IsMounted();
+}
+
+void FLuaScriptPack::Unmount()
+{
+#if PLATFORM_WINDOWS
+	if (m_pData)
+	{
+		UnmapViewOfFile(m_pData);
+	}
+	if (m_pMappingHandle)
+	{
+		CloseHandle(m_pMappingHandle);
+	}
+	if (m_pFileHandle)
+	{
+		CloseHandle(m_pFileHandle);
+	}
+#elif PLATFORM_LINUX || PLATFORM_MAC
+	if (m_pData)
+	{
+		munmap(const_cast<uint8*>(m_pData), m_DataSize);
+	}
+#endif
+
+	m_pData = nullptr;
+	m_DataSize = 0;
+	m_pFileHandle = nullptr;
+	m_pMappingHandle = nullptr;
+	m_FallbackData.Empty();
+}
+
+bool FLuaScriptPack::Validate() const
+{ // checked once at mount, FindChunk trusts the offsets afterwards
+	if (m_DataSize < (int64)sizeof(FLuaPackHeader))
+	{
+		return false;
+	}
+
+	const FLuaPackHeader *pHeader = reinterpret_cast<const FLuaPackHeader*>(m_pData);
+	if (pHeader->Magic != LuaPackMagic || pHeader->Version != LuaPackVersion)
+	{
+		return false;
+	}
+
+	if ((int64)sizeof(FLuaPackHeader) + (int64)pHeader->EntryNum * sizeof(FLuaPackEntry) > m_DataSize)
+	{
+		return false;
+	}
+
+	const FLuaPackEntry *pEntries = reinterpret_cast<const FLuaPackEntry*>(pHeader + 1);
+	for (uint32 i = 0; i < pHeader->EntryNum; ++i)
+	{
+		const FLuaPackEntry &Entry = pEntries[i];
+		if ((int64)Entry.NameOffset + Entry.NameSize + 1 > m_DataSize || m_pData[Entry.NameOffset + Entry.NameSize] != 0
+			|| (int64)Entry.ChunkOffset + Entry.ChunkSize > m_DataSize)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool FLuaScriptPack::FindChunk(const char *Name, const char *&OutChunk, int32 &OutChunkSize) const
+{ // binary search over the sorted entries
+	if (!IsMounted())
+	{
+		return false;
+	}
+
+	const FLuaPackHeader *pHeader = reinterpret_cast<const FLuaPackHeader*>(m_pData);
+	const FLuaPackEntry *pEntries = reinterpret_cast<const FLuaPackEntry*>(pHeader + 1);
+	int32 Low = 0;
+	int32 High = (int32)pHeader->EntryNum - 1;
+	while (Low <= High)
+	{
+		int32 Mid = (Low + High) / 2;
+		const FLuaPackEntry &Entry = pEntries[Mid];
+		int32 Result = FCStringAnsi::Strcmp(Name, reinterpret_cast<const char*>(m_pData + Entry.NameOffset));
+		if (Result == 0)
+		{
+			OutChunk = reinterpret_cast<const char*>(m_pData + Entry.ChunkOffset);
+			OutChunkSize = Entry.ChunkSize;
+			return true;
+		}
+		else if (Result < 0)
+		{
+			High = Mid - 1;
+		}
+		else
+		{
+			Low = Mid + 1;
+		}
+	}
+	return false;
+}
+
+int32 FLuaScriptPack::LoadChunk(lua_State *InLuaState, const char *pChunk, int32 ChunkSize, const char *ChunkName)
+{
+	FLuaPackReader Reader;
+	Reader.pChunk = pChunk;
+	Reader.ChunkSize = ChunkSize;
+	return lua_load(InLuaState, LuaPackChunkReader, &Reader, ChunkName);
+}
+
+static int32 LuaPackDumpWriter(lua_State *InLuaState, const void *pData, size_t Size, void *pUserData)
+{
+	static_cast<TArray<uint8>*>(pUserData)->Append(static_cast<const uint8*>(pData), Size);
+	return 0;
+}
+
+bool FLuaScriptPack::Build(const FString &SourceDir, const FString &PackFilePath)
+{
+	TArray<FString> FilePaths;
+	IFileManager::Get().FindFilesRecursive(FilePaths, *SourceDir, TEXT("*.lua"), true, false);
+
+	TArray<TPair<FString, TArray<uint8>>> Chunks; // relative name, bytecode
+	lua_State *pLuaState = luaL_newstate();
+	bool bSuccess = true;
+	for (const FString &FilePath : FilePaths)
+	{
+		FString Name = FilePath;
+		FPaths::MakePathRelativeTo(Name, *(SourceDir / TEXT("")));
+
+		TArray<uint8> Source;
+		FString ChunkName = FString(TEXT("@LuaSource/")) + Name;
+		if (!FFileHelper::LoadFileToArray(Source, *FilePath) || luaL_loadbuffer(pLuaState, reinterpret_cast<const char*>(Source.GetData()), Source.Num(), TCHAR_TO_UTF8(*ChunkName)) != 0)
+		{
+			LuaWrapperLog(Error, TEXT("FLuaScriptPack::Build failed to compile %s: %s"), *FilePath, UTF8_TO_TCHAR(lua_tostring(pLuaState, -1)));
+			bSuccess = false;
+			break;
+		}
+
+		TPair<FString, TArray<uint8>> Chunk;
+		Chunk.Key = Name;
+		lua_dump(pLuaState, LuaPackDumpWriter, &Chunk.Value);
+		lua_pop(pLuaState, 1);
+		Chunks.Add(MoveTemp(Chunk));
+	}
+	lua_close(pLuaState);
+
+	if (!bSuccess)
+	{
+		return false;
+	}
+
+	// FindChunk compares the utf8 names with strcmp, sort by the same bytes that are written
+	Chunks.Sort([](const TPair<FString, TArray<uint8>> &A, const TPair<FString, TArray<uint8>> &B) { return FCStringAnsi::Strcmp(FTCHARToUTF8(*A.Key).Get(), FTCHARToUTF8(*B.Key).Get()) < 0; });
+
+	TArray<uint8> Names;
+	TArray<uint8> ChunkData;
+	TArray<FLuaPackEntry> Entries;
+	uint32 NamesOffset = sizeof(FLuaPackHeader) + Chunks.Num() * sizeof(FLuaPackEntry);
+	for (const TPair<FString, TArray<uint8>> &Chunk : Chunks)
+	{
+		FTCHARToUTF8 Utf8Name(*Chunk.Key);
+		FLuaPackEntry Entry;
+		Entry.NameOffset = NamesOffset + Names.Num();
+		Entry.NameSize = Utf8Name.Length();
+		Entry.ChunkOffset = ChunkData.Num(); // fixed up below
+		Entry.ChunkSize = Chunk.Value.Num();
+		Entries.Add(Entry);
+
+		Names.Append(reinterpret_cast<const uint8*>(Utf8Name.Get()), Utf8Name.Length());
+		Names.Add(0);
+		ChunkData.Append(Chunk.Value);
+	}
+
+	uint32 ChunksOffset = NamesOffset + Names.Num();
+	for (FLuaPackEntry &Entry : Entries)
+	{
+		Entry.ChunkOffset += ChunksOffset;
+	}
+
+	FLuaPackHeader Header;
+	Header.Magic = LuaPackMagic;
+	Header.Version = LuaPackVersion;
+	Header.EntryNum = Entries.Num();
+
+	TArray<uint8> PackData;
+	PackData.Append(reinterpret_cast<const uint8*>(&Header), sizeof(Header));
+	PackData.Append(reinterpret_cast<const uint8*>(Entries.GetData()), Entries.Num() * sizeof(FLuaPackEntry));
+	PackData.Append(Names);
+	PackData.Append(ChunkData);
+
+	if (!FFileHelper::SaveArrayToFile(PackData, *PackFilePath))
+	{
+		LuaWrapperLog(Error, TEXT("FLuaScriptPack::Build failed to save %s"), *PackFilePath);
+		return false;
+	}
+
+	LuaWrapperLog(Log, TEXT("FLuaScriptPack::Build %d scripts into %s"), Chunks.Num(), *PackFilePath);
+	return true;
+}
+
+FString FLuaScriptPack::GetDefaultPackPath()
+{ // staged as a loose file, see DirectoriesToAlwaysStageAsNonUFS in DefaultGame.ini
+	return FPaths::ConvertRelativePathToFull(FPaths::GameContentDir() / TEXT("LuaPack/LuaSource.luapack"));
+}
+
+bool FLuaScriptPack::BuildDefaultPack()
+{
+	return Build(FPaths::ConvertRelativePathToFull(FPaths::GameDir() / TEXT("LuaSource")), GetDefaultPackPath());
+}
+
+#if WITH_EDITOR
+void FLuaScriptPack::RegisterCookHook()
+{ // the cook modification delegate runs before the cooked files are collected, so staging always
+  // picks up a pack matching LuaSource. a delegate the game bound already is kept and called after
+	FCookModificationDelegate &CookDelegate = FGameDelegates::Get().GetCookModificationDelegate();
+	FCookModificationDelegate PreviousDelegate = CookDelegate;
+	CookDelegate.BindLambda([PreviousDelegate](TArray<FString> &ExtraPackagesToCook)
+	{
+		if (!BuildDefaultPack())
+		{
+			LuaWrapperLog(Error, TEXT("FLuaScriptPack: the cooked build has no up to date script pack"));
+		}
+		PreviousDelegate.ExecuteIfBound(ExtraPackagesToCook);
+	});
+}
+#endif
+
+#if !UE_BUILD_SHIPPING
+static void BuildDefaultLuaScriptPack()
+{
+	FLuaScriptPack::BuildDefaultPack();
+}
+
+static FAutoConsoleCommand BuildLuaScriptPackCommand(
+	TEXT("Lua.BuildScriptPack"),
+	TEXT("Compile LuaSource into the script pack used by shipping builds"),
+	FConsoleCommandDelegate::CreateStatic(BuildDefaultLuaScriptPack));
+#endif
@@ -0,0 +1,37 @@
+#pragma once
+#include "CoreMinimal.h"
+#include "LuaWrapperDefine.h"
+
+// precompiled scripts of LuaSource in one file, memory mapped read only.
+// layout: FLuaPackHeader, FLuaPackEntry[EntryNum] sorted by name, names, chunks
+class FLuaScriptPack
+{
+public:
+	FLuaScriptPack();
+	~FLuaScriptPack();
+
+public:
+	bool Mount(const FString &PackFilePath);
+	void Unmount();
+	bool IsMounted() const { return m_pData != nullptr; }
+	bool FindChunk(const char *Name, const char *&OutChunk, int32 &OutChunkSize) const; // Name relative to LuaSource, like "main.lua"
+
+public:
+	static int32 LoadChunk(lua_State *InLuaState, const char *pChunk, int32 ChunkSize, const char *ChunkName); // lua_load a chunk from FindChunk without copying
+	static bool Build(const FString &SourceDir, const FString &PackFilePath);
+	static FString GetDefaultPackPath();
+	static bool BuildDefaultPack(); // LuaSource into GetDefaultPackPath
+#if WITH_EDITOR
+	static void RegisterCookHook(); // cook by the book rebuilds the pack before staging
+#endif
+
+private:
+	bool Validate() const;
+
+private:
+	const uint8 *m_pData;
+	int64 m_DataSize;
+	void *m_pFileHandle;
+	void *m_pMappingHandle;
+	TArray<uint8> m_FallbackData; // platforms without mmap read the whole file
+};
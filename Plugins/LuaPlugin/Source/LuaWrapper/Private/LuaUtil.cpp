@@ -1,14 +1,172 @@
 #include "LuaUtil.h"
+#include "CoreUObject.h"
+#include "LuaObjectReferencer.h"
+#include "LuaProfiler.h"
+
+// address used as light userdata key of the userdata cache table in every class metatable
+static char UserDataCacheKey;
+// addresses used as light userdata keys of the property getter/setter tables in every class metatable
+static char PropertyGetterKey;
+static char PropertySetterKey;
+// address used as light userdata key of the FName string cache in the registry
+static char NameCacheKey;
+// address used as light userdata key of the registry ref of the shared error handler
+static char ErrorHandlerRefKey;
+// address used as light userdata key of the weak keyed member userdata -> owner userdata table in the registry
+static char OwnerTableKey;
+
+// address used as light userdata key of the string conversion buffers in the registry
+static char StringScratchKey;
+
+// reused by every string conversion of a state, lua_pushlstring copies the bytes.
+// a userdata in the registry, so every state has its own and frees it on lua_close
+struct FLuaStringScratch
+{
+	TArray<ANSICHAR> Ansi;
+	TArray<TCHAR> TChar;
+};
+
+// classes not registered until first use, one table sorted by name per generated register shard
+static TArray<TPair<const FLuaClassRegInfo*, int32>> LazyClassTables;
 
 void FLuaUtil::RegisterClass(lua_State *InLuaState, const luaL_Reg ClassFunctions[], const char *ClassName)
 {
-	AddClass(InLuaState, ClassName);
+	RegisterClass(InLuaState, ClassFunctions, nullptr, nullptr, ClassName, INDEX_NONE, INDEX_NONE);
+}
+
+void FLuaUtil::RegisterClass(lua_State *InLuaState, const luaL_Reg ClassFunctions[], const luaL_Reg PropertyGetters[], const luaL_Reg PropertySetters[], const char *ClassName, int32 ClassId, int32 ClassIdEnd)
+{
+	AddClass(InLuaState, ClassName, ClassId, ClassIdEnd);
 	OpenClass(InLuaState,ClassName);
 	RegisterClassFunctions(InLuaState,ClassFunctions);
+	RegisterPropertyFunctions(InLuaState, &PropertyGetterKey, PropertyGetters);
+	RegisterPropertyFunctions(InLuaState, &PropertySetterKey, PropertySetters);
 	CloseClass(InLuaState);
+
+	if (g_LuaProfiler && g_LuaProfiler->IsRunning())
+	{ // Start names the classes registered before it, lazy classes can show up while profiling
+		luaL_getmetatable(InLuaState, ClassName);
+		g_LuaProfiler->AddClassNames(InLuaState, lua_gettop(InLuaState));
+		lua_pop(InLuaState, 1);
+	}
+}
+
+static int32 GlobalIndexFunc(lua_State *InLuaState)
+{
+	// _G[key], key is not a global yet
+	// stack 1: _G
+	// stack 2: key
+	// upvalue 1: __index _G had before, nil if none
+	if (lua_type(InLuaState, 2) == LUA_TSTRING && FLuaUtil::RegisterLazyClass(InLuaState, lua_tostring(InLuaState, 2)))
+	{
+		lua_rawget(InLuaState, 1);
+		return 1;
+	}
+
+	lua_pushvalue(InLuaState, lua_upvalueindex(1));
+	if (lua_isfunction(InLuaState, -1))
+	{
+		lua_pushvalue(InLuaState, 1);
+		lua_pushvalue(InLuaState, 2);
+		lua_call(InLuaState, 2, 1);
+		return 1;
+	}
+	else if (lua_istable(InLuaState, -1))
+	{
+		lua_pushvalue(InLuaState, 2);
+		lua_gettable(InLuaState, -2);
+		return 1;
+	}
+	return 0;
+}
+
+void FLuaUtil::RegisterLazyClasses(lua_State *InLuaState, const FLuaClassRegInfo ClassRegInfos[], int32 ClassNum)
+{
+	bool bAddedTable = false;
+	for (const TPair<const FLuaClassRegInfo*, int32> &LazyClassTable : LazyClassTables)
+	{
+		bAddedTable |= LazyClassTable.Key == ClassRegInfos;
+	}
+
+	if (!bAddedTable)
+	{
+		LazyClassTables.Add(TPair<const FLuaClassRegInfo*, int32>(ClassRegInfos, ClassNum));
+	}
+
+	if (lua_getmetatable(InLuaState, LUA_GLOBALSINDEX))
+	{
+		lua_pushstring(InLuaState, "__index");
+		lua_rawget(InLuaState, -2);
+		if (lua_tocfunction(InLuaState, -1) == GlobalIndexFunc)
+		{ // installed by an earlier shard
+			lua_pop(InLuaState, 2);
+			return;
+		}
+	}
+	else
+	{
+		lua_newtable(InLuaState);
+		lua_pushnil(InLuaState);
+	}
+
+	// metatable of _G, its old __index
+	lua_pushcclosure(InLuaState, GlobalIndexFunc, 1);
+	lua_pushstring(InLuaState, "__index");
+	lua_insert(InLuaState, -2);
+	lua_rawset(InLuaState, -3);
+	lua_setmetatable(InLuaState, LUA_GLOBALSINDEX);
+}
+
+void FLuaUtil::ResetLazyClasses()
+{
+	LazyClassTables.Reset();
+}
+
+bool FLuaUtil::RegisterLazyClass(lua_State *InLuaState, const char *ClassName)
+{ // binary search every shard table, no lua or heap allocation for names that are not classes
+	for (const TPair<const FLuaClassRegInfo*, int32> &LazyClassTable : LazyClassTables)
+	{
+		int32 Low = 0;
+		int32 High = LazyClassTable.Value - 1;
+		while (Low <= High)
+		{
+			int32 Mid = (Low + High) / 2;
+			const FLuaClassRegInfo &RegInfo = LazyClassTable.Key[Mid];
+			int32 Result = FCStringAnsi::Strcmp(ClassName, RegInfo.ClassName);
+			if (Result == 0)
+			{
+				if (ExistClass(InLuaState, ClassName))
+				{
+					return false;
+				}
+
+				RegisterClass(InLuaState, RegInfo.ClassFunctions, RegInfo.PropertyGetters, RegInfo.PropertySetters, RegInfo.ClassName, RegInfo.ClassId, RegInfo.ClassIdEnd);
+				return true;
+			}
+			else if (Result < 0)
+			{
+				High = Mid - 1;
+			}
+			else
+			{
+				Low = Mid + 1;
+			}
+		}
+	}
+	return false;
+}
+
+void FLuaUtil::PushMetaTable(lua_State *InLuaState, const char *ClassName)
+{
+	luaL_getmetatable(InLuaState, ClassName);
+	if (lua_isnil(InLuaState, -1) && RegisterLazyClass(InLuaState, ClassName))
+	{
+		lua_pop(InLuaState, 1);
+		luaL_getmetatable(InLuaState, ClassName);
+	}
 }
 
-void FLuaUtil::AddClass(lua_State *InLuaState, const char *ClassName)
+void FLuaUtil::AddClass(lua_State *InLuaState, const char *ClassName, int32 ClassId, int32 ClassIdEnd)
 { // classΪtable,ӵluaȫֱ
 	if (ExistClass(InLuaState, ClassName))
 	{
@@ -22,7 +180,8 @@ void FLuaUtil::AddClass(lua_State *InLuaState, const char *ClassName)
 
 	{// ñ
 		InitMetaMethods(InLuaState);  // Ԫ
-		InitUserDefinedFuncs(InLuaState, ClassName); // ûԶ
+		InitUserDefinedFuncs(InLuaState, ClassName, ClassId, ClassIdEnd); // ûԶ
+		InitUserDataCache(InLuaState);
 	}
 
 	lua_rawset(InLuaState, -3); // ȫֱModuleNamel_gt,
@@ -53,6 +212,19 @@ void FLuaUtil::RegisterClassFunctions( lua_State *InLuaState, const luaL_Reg Cla
 	}
 }
 
+void FLuaUtil::RegisterPropertyFunctions(lua_State *InLuaState, void *PropertyTableKey, const luaL_Reg PropertyFunctions[])
+{ // fill metatable[PropertyTableKey], the class table is at the top of the stack
+	if (PropertyFunctions == nullptr)
+	{
+		return;
+	}
+
+	lua_pushlightuserdata(InLuaState, PropertyTableKey);
+	lua_rawget(InLuaState, -2);
+	RegisterClassFunctions(InLuaState, PropertyFunctions);
+	lua_pop(InLuaState, 1);
+}
+
 void FLuaUtil::AddClassFunction(lua_State *InLuaState, const char *FuncName, lua_CFunction &luaFunction)
 {
 	lua_pushstring(InLuaState, FuncName);
@@ -66,18 +238,17 @@ int32 MetaTableNewIndexFunc(lua_State* L)
 	// stack 1: userdata
 	// stack 2: key
 	// stack 3: value
+	// upvalue 1: property setters of the class
 	if (lua_isuserdata(L, 1)==1)
 	{
-		lua_getmetatable(L, 1);
-		FString PropertyName = FString(lua_tostring(L, 2));
-		FString SetPropertyFuncName = FString::Printf(TEXT("Set_%s"), *PropertyName);
-		FLuaUtil::Push(L, SetPropertyFuncName);
-		lua_rawget(L, -2); // get function
-		if (!lua_isnil(L, -1))
-		{
-			lua_pushvalue(L, 1);
-			lua_pushvalue(L, 3);
-			lua_call(L, 2, 0);
+		lua_pushvalue(L, 2);
+		lua_rawget(L, lua_upvalueindex(1));
+		lua_CFunction SetPropertyFunc = lua_tocfunction(L, -1);
+		if (SetPropertyFunc)
+		{ // setter reads userdata at 1 and value at 2
+			lua_pop(L, 1);
+			lua_remove(L, 2);
+			SetPropertyFunc(L);
 		}
 	}
 	else if (lua_istable(L, 1))
@@ -93,43 +264,207 @@ int32 MetaTableIndexFunc(lua_State* L)
 	// userdata[key];
 	// stack 1: userdata
 	// stack 2: key
+	// upvalue 1: property getters of the class
 	lua_getmetatable(L, 1);
 	lua_pushvalue(L, -2);
 	lua_rawget(L, -2);
 	if (lua_isnil(L, -1))
 	{
-		lua_pop(L, 1);
-		FString PropertyName = FString(lua_tostring(L, 2));
-		FString GetPropertyFuncName = FString::Printf(TEXT("Get_%s"), *PropertyName);
-		FLuaUtil::Push(L, GetPropertyFuncName);
-		lua_rawget(L, -2); // get function
-		if (!lua_isnil(L, -1))
+		lua_pushvalue(L, 2);
+		lua_rawget(L, lua_upvalueindex(1));
+		lua_CFunction GetPropertyFunc = lua_tocfunction(L, -1);
+		if (GetPropertyFunc)
+		{ // getter reads userdata at 1 and pushes the value
+			lua_settop(L, 1);
+			return GetPropertyFunc(L);
+		}
+	}
+	return 1;
+}
+
+
+static bool PushPropertyTable(lua_State *InLuaState, int32 LuaStackIndex, void *PropertyTableKey)
+{ // getters or setters of the class of the userdata, the same tables __index and __newindex use
+	if (!lua_getmetatable(InLuaState, LuaStackIndex))
+	{
+		return false;
+	}
+
+	lua_pushlightuserdata(InLuaState, PropertyTableKey);
+	lua_rawget(InLuaState, -2);
+	lua_remove(InLuaState, -2);
+	if (!lua_istable(InLuaState, -1))
+	{
+		lua_pop(InLuaState, 1);
+		return false;
+	}
+	return true;
+}
+
+int32 FLuaUtil::GetMany(lua_State *InLuaState, int32 LuaStackIndex, const char *const PropertyNames[], int32 PropertyNum)
+{
+	int32 ObjIndex = LuaStackIndex > 0 ? LuaStackIndex : lua_gettop(InLuaState) + LuaStackIndex + 1;
+	if (!PushPropertyTable(InLuaState, ObjIndex, &PropertyGetterKey))
+	{
+		PushNils(InLuaState, PropertyNum);
+		return PropertyNum;
+	}
+
+	int32 GetterTableIndex = lua_gettop(InLuaState);
+	for (int32 i = 0; i < PropertyNum; ++i)
+	{
+		lua_pushstring(InLuaState, PropertyNames[i]);
+		lua_rawget(InLuaState, GetterTableIndex);
+		if (lua_iscfunction(InLuaState, -1))
+		{ // getters read the userdata at 1 of their own frame
+			lua_pushvalue(InLuaState, ObjIndex);
+			lua_call(InLuaState, 1, 1);
+		}
+		else
 		{
-			lua_pushvalue(L, 1);
-			lua_call(L, 1, 1);
+			lua_pop(InLuaState, 1);
+			lua_pushnil(InLuaState);
 		}
 	}
+	lua_remove(InLuaState, GetterTableIndex);
+	return PropertyNum;
+}
+
+void FLuaUtil::SetMany(lua_State *InLuaState, int32 LuaStackIndex, int32 TableIndex)
+{
+	int32 Top = lua_gettop(InLuaState);
+	int32 ObjIndex = LuaStackIndex > 0 ? LuaStackIndex : Top + LuaStackIndex + 1;
+	TableIndex = TableIndex > 0 ? TableIndex : Top + TableIndex + 1;
+	if (!lua_istable(InLuaState, TableIndex) || !PushPropertyTable(InLuaState, ObjIndex, &PropertySetterKey))
+	{
+		return;
+	}
+
+	int32 SetterTableIndex = lua_gettop(InLuaState);
+	lua_pushnil(InLuaState);
+	while (lua_next(InLuaState, TableIndex))
+	{ // key at -2, value at -1
+		lua_pushvalue(InLuaState, -2);
+		lua_rawget(InLuaState, SetterTableIndex);
+		if (lua_iscfunction(InLuaState, -1))
+		{ // setters read the userdata at 1 and the value at 2
+			lua_pushvalue(InLuaState, ObjIndex);
+			lua_pushvalue(InLuaState, -3);
+			lua_call(InLuaState, 2, 0);
+		}
+		else
+		{
+			lua_pop(InLuaState, 1);
+		}
+		lua_pop(InLuaState, 1);
+	}
+	lua_settop(InLuaState, Top);
+}
+
+int32 FLuaUtil::GetManyFunc(lua_State *InLuaState)
+{
+	// stack 1: userdata
+	// stack 2: array of property names
+	// stack 3: table filled and returned, optional
+	luaL_checktype(InLuaState, 2, LUA_TTABLE);
+	if (lua_istable(InLuaState, 3))
+	{
+		lua_settop(InLuaState, 3);
+	}
+	else
+	{
+		lua_settop(InLuaState, 2);
+		lua_newtable(InLuaState);
+	}
+
+	if (!PushPropertyTable(InLuaState, 1, &PropertyGetterKey))
+	{ // 4: no getters, every name reads nil
+		lua_pushnil(InLuaState);
+	}
+
+	int32 PropertyNum = lua_objlen(InLuaState, 2);
+	for (int32 i = 1; i <= PropertyNum; ++i)
+	{
+		lua_rawgeti(InLuaState, 2, i); // 5: name
+		if (lua_isnil(InLuaState, 5))
+		{
+			lua_pop(InLuaState, 1);
+			continue;
+		}
+
+		lua_pushvalue(InLuaState, 5);
+		if (lua_istable(InLuaState, 4))
+		{
+			lua_rawget(InLuaState, 4);
+		}
+		if (lua_iscfunction(InLuaState, -1))
+		{
+			lua_pushvalue(InLuaState, 1);
+			lua_call(InLuaState, 1, 1);
+		}
+		else
+		{ // a reused out table must not keep the value of an earlier call
+			lua_pop(InLuaState, 1);
+			lua_pushnil(InLuaState);
+		}
+		lua_rawset(InLuaState, 3);
+	}
+	lua_settop(InLuaState, 3);
 	return 1;
 }
 
+int32 FLuaUtil::SetManyFunc(lua_State *InLuaState)
+{
+	// stack 1: userdata
+	// stack 2: table of property name -> value
+	luaL_checktype(InLuaState, 2, LUA_TTABLE);
+	SetMany(InLuaState, 1, 2);
+	return 0;
+}
+
+static void ReleaseOwnedObject(FLuaUserData *pUserData)
+{ // borrowed pointers cost nothing
+	switch (pUserData->Ownership)
+	{
+	case EOwned:
+		if (pUserData->Destructor)
+		{
+			pUserData->Destructor(pUserData->pObj);
+		}
+		break;
+	case ERooted:
+		if (g_LuaObjectReferencer)
+		{
+			g_LuaObjectReferencer->RemoveUserData(pUserData);
+		}
+		break;
+	default:
+		break;
+	}
+
+	pUserData->Ownership = EBorrowed;
+}
 
 int32 GCCallBack(lua_State *InLuaState)
 {
-	lua_getmetatable(InLuaState, -1);
-	lua_getfield(InLuaState, -1, "ClassName");
-	FLuaUtil::TemplateLogError(FString::Printf(TEXT("ClassName:%s call gc func"), ANSI_TO_TCHAR(lua_tostring(InLuaState, -1))));
-	lua_pop(InLuaState, 2);
+	FLuaUserData *pUserData = static_cast<FLuaUserData*>(lua_touserdata(InLuaState, 1));
+	if (pUserData)
+	{
+		ReleaseOwnedObject(pUserData);
+	}
 	return 0;
 }
 
 void FLuaUtil::InitMetaMethods(lua_State *InLuaState)
 {
 	lua_pushstring(InLuaState, "__index");
-	lua_pushcfunction(InLuaState, MetaTableIndexFunc);
+	PushNewPropertyTable(InLuaState, &PropertyGetterKey);
+	lua_pushcclosure(InLuaState, MetaTableIndexFunc, 1);
 	lua_rawset(InLuaState, -3);
 
 	lua_pushstring(InLuaState, "__newindex");
-	lua_pushcfunction(InLuaState, MetaTableNewIndexFunc);
+	PushNewPropertyTable(InLuaState, &PropertySetterKey);
+	lua_pushcclosure(InLuaState, MetaTableNewIndexFunc, 1);
 	lua_rawset(InLuaState, -3);
 
 	lua_pushstring(InLuaState, "__gc");
@@ -137,7 +472,7 @@ void FLuaUtil::InitMetaMethods(lua_State *InLuaState)
 	lua_rawset(InLuaState, -3);
 }
 
-void FLuaUtil::InitUserDefinedFuncs(lua_State *InLuaState, const char *ClassName)
+void FLuaUtil::InitUserDefinedFuncs(lua_State *InLuaState, const char *ClassName, int32 ClassId, int32 ClassIdEnd)
 {
 	{ // 趨,Ƿcppclass
 		lua_pushstring(InLuaState, "IsCppClass");
@@ -151,26 +486,84 @@ void FLuaUtil::InitUserDefinedFuncs(lua_State *InLuaState, const char *ClassName
 		lua_rawset(InLuaState, -3);
 	}
 
+	{ // class id range [ClassId, ClassIdEnd) covers the class and all its exported children
+		lua_pushstring(InLuaState, "ClassId");
+		lua_pushinteger(InLuaState, ClassId);
+		lua_rawset(InLuaState, -3);
+
+		lua_pushstring(InLuaState, "ClassIdEnd");
+		lua_pushinteger(InLuaState, ClassIdEnd);
+		lua_rawset(InLuaState, -3);
+	}
 }
 
-bool FLuaUtil::ExistData(lua_State *InLuaState, const FString &UserDataKey)
-{
-	lua_getfield(InLuaState, LUA_REGISTRYINDEX, "_existuserdata");
-	Push(InLuaState, UserDataKey);
-	lua_rawget(InLuaState, -2);
-	bool bExist = lua_isnil(InLuaState, -1)==0;
-	lua_pop(InLuaState, 2);
-	return bExist;
+void FLuaUtil::PushNewPropertyTable(lua_State *InLuaState, void *PropertyTableKey)
+{ // metatable[PropertyTableKey] = {}, the metatable is under the pushed meta method name
+	lua_newtable(InLuaState);
+	lua_pushlightuserdata(InLuaState, PropertyTableKey);
+	lua_pushvalue(InLuaState, -2);
+	lua_rawset(InLuaState, -5);
+}
+
+void FLuaUtil::InitUserDataCache(lua_State *InLuaState)
+{ // metatable[&UserDataCacheKey] = setmetatable({}, {__mode = "v"}), pushed userdatas keyed by raw pointer
+	lua_pushlightuserdata(InLuaState, &UserDataCacheKey);
+	lua_newtable(InLuaState);
+	lua_newtable(InLuaState);
+	lua_pushstring(InLuaState, "__mode");
+	lua_pushstring(InLuaState, "v");
+	lua_rawset(InLuaState, -3);
+	lua_setmetatable(InLuaState, -2);
+	lua_rawset(InLuaState, -3);
 }
 
 bool FLuaUtil::ExistClass(lua_State *InLuaState, const char *ClassName)
-{
-	lua_getglobal(InLuaState, ClassName);
+{ // raw, must not trigger the lazy registration of _G
+	lua_pushstring(InLuaState, ClassName);
+	lua_rawget(InLuaState, LUA_GLOBALSINDEX);
 	bool bExistClass = lua_istable(InLuaState, -1)==1;
 	lua_pop(InLuaState, 1);
 	return bExistClass;
 }
 
+FLuaUserData* FLuaUtil::ToCppUserData(lua_State *InLuaState, int32 LuaStackIndex)
+{ // only class metatables own a userdata cache, no lookup by class name needed
+	if (lua_getmetatable(InLuaState, LuaStackIndex) == 0)
+	{
+		return nullptr;
+	}
+
+	lua_pushlightuserdata(InLuaState, &UserDataCacheKey);
+	lua_rawget(InLuaState, -2);
+	bool bCppUserData = lua_istable(InLuaState, -1) == 1;
+	lua_pop(InLuaState, 2);
+	return bCppUserData ? static_cast<FLuaUserData*>(lua_touserdata(InLuaState, LuaStackIndex)) : nullptr;
+}
+
+bool FLuaUtil::ResolveClassId(lua_State *InLuaState, const char *ClassName, int32 &OutClassId, int32 &OutClassIdEnd)
+{ // only done once per template type, the result is cached in TLuaClassId
+	PushMetaTable(InLuaState, ClassName);
+	if (!lua_istable(InLuaState, -1))
+	{
+		lua_pop(InLuaState, 1);
+		return false;
+	}
+
+	lua_getfield(InLuaState, -1, "ClassId");
+	lua_getfield(InLuaState, -2, "ClassIdEnd");
+	int32 ClassId = lua_tointeger(InLuaState, -2);
+	int32 ClassIdEnd = lua_tointeger(InLuaState, -1);
+	lua_pop(InLuaState, 3);
+	if (ClassIdEnd <= 0)
+	{ // registered without class id
+		return false;
+	}
+
+	OutClassId = ClassId;
+	OutClassIdEnd = ClassIdEnd;
+	return true;
+}
+
 void FLuaUtil::TemplateLogPrint(const FString &Content)
 {
 	LuaWrapperLog(Log, TEXT("%s"), *Content);
@@ -191,24 +584,13 @@ void FLuaUtil::TemplateLogFatal(const FString &Content)
 	LuaWrapperLog(Fatal, TEXT("%s"), *Content);
 }
 
-FString FLuaUtil::AdjustUserdataKey(const FString &InUserdataKey)
-{
-	FString Ret = InUserdataKey;
-	for (int32 i=0; i<Ret.Len(); ++i)
-	{
-		if (Ret[i] == '\0')
-		{
-			TemplateLogError(FString::Printf(TEXT("there are zero!")));
-			Ret[i] = '1';
-		}
-	}
-	return Ret;
-}
-
 void FLuaUtil::PushObjInner(lua_State *InLuaState, void *pObj, const char *pName)
 {
-	if (!ExistClass(InLuaState, pName))
+	PushMetaTable(InLuaState, pName); // metatable
+	if (!lua_istable(InLuaState, -1))
 	{
+		lua_pop(InLuaState, 1);
+		lua_pushnil(InLuaState);
 		FString log = FString::Printf(TEXT("push error, not export this class:%s"), ANSI_TO_TCHAR(pName));
 		TemplateLogError(log);
 		return ;
@@ -216,28 +598,73 @@ void FLuaUtil::PushObjInner(lua_State *InLuaState, void *pObj, const char *pName
 
 	if (pObj == nullptr)
 	{
+		lua_pop(InLuaState, 1);
 		lua_pushnil(InLuaState);
 		return ;
 	}
 
-	char*pUserDataKey = TCHAR_TO_ANSI(*FString::Printf(TEXT("%p%s"), pObj, ANSI_TO_TCHAR(pName)));
-	lua_getfield(InLuaState, LUA_REGISTRYINDEX, "_existuserdata");
-	lua_getfield(InLuaState, -1, pUserDataKey);
-	if (lua_isnil(InLuaState, -1) == 1)
+	lua_pushlightuserdata(InLuaState, &UserDataCacheKey);
+	lua_rawget(InLuaState, -2); // metatable, cache
+	lua_pushlightuserdata(InLuaState, pObj);
+	lua_rawget(InLuaState, -2); // metatable, cache, userdata or nil
+	if (lua_isnil(InLuaState, -1) == 1 || static_cast<FLuaUserData*>(lua_touserdata(InLuaState, -1))->pObj != pObj) // pObj is nulled when the object was collected
 	{ // ûҵ
+		lua_pop(InLuaState, 1);
+		lua_getfield(InLuaState, -2, "ClassId");
+		lua_getfield(InLuaState, -3, "ClassIdEnd");
+		int32 ClassId = lua_tointeger(InLuaState, -2);
+		int32 ClassIdEnd = lua_tointeger(InLuaState, -1);
 		lua_pop(InLuaState, 2);
-		*(void**)lua_newuserdata(InLuaState, sizeof(void*)) = pObj;
-		luaL_getmetatable(InLuaState, pName);
+
+		FLuaUserData *pUserData = static_cast<FLuaUserData*>(lua_newuserdata(InLuaState, sizeof(FLuaUserData)));
+		pUserData->pObj = pObj;
+		pUserData->ClassId = ClassId;
+		pUserData->ClassIdEnd = ClassIdEnd;
+		pUserData->Destructor = nullptr;
+		pUserData->Ownership = EBorrowed;
+		pUserData->ReferenceIndex = INDEX_NONE;
+		lua_pushvalue(InLuaState, -3);
 		lua_setmetatable(InLuaState, -2);
-		lua_getfield(InLuaState, LUA_REGISTRYINDEX, "_existuserdata");
+		lua_pushlightuserdata(InLuaState, pObj);
 		lua_pushvalue(InLuaState, -2);
-		lua_setfield(InLuaState, -2, pUserDataKey);
-		lua_pop(InLuaState, 1);
+		lua_rawset(InLuaState, -4); // cache[pObj] = userdata
 	}
-	else
+
+	lua_replace(InLuaState, -3);
+	lua_pop(InLuaState, 1);
+}
+
+void* FLuaUtil::PushValueInner(lua_State *InLuaState, int32 ValueSize, int32 ValueAlign, const char *pName, void (*Destructor)(void*))
+{ // userdata block: FLuaUserData, padding, value. not cached, every push is a new value
+	PushMetaTable(InLuaState, pName); // metatable
+	if (!lua_istable(InLuaState, -1))
 	{
-		lua_replace(InLuaState, -2);
+		lua_pop(InLuaState, 1);
+		lua_pushnil(InLuaState);
+		FString log = FString::Printf(TEXT("push error, not export this class:%s"), ANSI_TO_TCHAR(pName));
+		TemplateLogError(log);
+		return nullptr;
 	}
+
+	lua_getfield(InLuaState, -1, "ClassId");
+	lua_getfield(InLuaState, -2, "ClassIdEnd");
+	int32 ClassId = lua_tointeger(InLuaState, -2);
+	int32 ClassIdEnd = lua_tointeger(InLuaState, -1);
+	lua_pop(InLuaState, 2);
+
+	// lua only guarantees the alignment of a double, over-allocate for stricter types
+	uint8 *pBlock = static_cast<uint8*>(lua_newuserdata(InLuaState, sizeof(FLuaUserData) + ValueSize + ValueAlign - 1));
+	FLuaUserData *pUserData = reinterpret_cast<FLuaUserData*>(pBlock);
+	pUserData->pObj = Align(pBlock + sizeof(FLuaUserData), ValueAlign);
+	pUserData->ClassId = ClassId;
+	pUserData->ClassIdEnd = ClassIdEnd;
+	pUserData->Destructor = Destructor;
+	pUserData->Ownership = EOwned;
+	pUserData->ReferenceIndex = INDEX_NONE;
+	lua_pushvalue(InLuaState, -2);
+	lua_setmetatable(InLuaState, -2);
+	lua_replace(InLuaState, -2);
+	return pUserData->pObj;
 }
 
 void FLuaUtil::LuaPop(lua_State *InLuaState, int32 Num)
@@ -245,6 +672,29 @@ void FLuaUtil::LuaPop(lua_State *InLuaState, int32 Num)
 	lua_pop(InLuaState, Num);
 }
 
+void FLuaUtil::LuaRemove(lua_State *InLuaState, int32 LuaStackIndex)
+{
+	lua_remove(InLuaState, LuaStackIndex);
+}
+
+int32 FLuaUtil::LuaGetTop(lua_State *InLuaState)
+{
+	return lua_gettop(InLuaState);
+}
+
+void FLuaUtil::LuaSetTop(lua_State *InLuaState, int32 LuaStackIndex)
+{
+	lua_settop(InLuaState, LuaStackIndex);
+}
+
+void FLuaUtil::PushNils(lua_State *InLuaState, int32 Num)
+{
+	for (int32 i = 0; i < Num; ++i)
+	{
+		lua_pushnil(InLuaState);
+	}
+}
+
 void FLuaUtil::LuaPushErrorFunc(lua_State *InLuaState)
 {
 	lua_pushcfunction(InLuaState, LuaErrHandleFunc);
@@ -295,9 +745,123 @@ int32 FLuaUtil::Push(lua_State *InLuaState,bool value)
 	return 1;
 }
 
+static int32 StringScratchGC(lua_State *InLuaState)
+{
+	static_cast<FLuaStringScratch*>(lua_touserdata(InLuaState, 1))->~FLuaStringScratch();
+	return 0;
+}
+
+static FLuaStringScratch& GetStringScratch(lua_State *InLuaState)
+{ // shared by the coroutines of the state, they never run at the same time
+	lua_pushlightuserdata(InLuaState, &StringScratchKey);
+	lua_rawget(InLuaState, LUA_REGISTRYINDEX);
+	FLuaStringScratch *pScratch = static_cast<FLuaStringScratch*>(lua_touserdata(InLuaState, -1));
+	lua_pop(InLuaState, 1);
+	if (pScratch == nullptr)
+	{
+		pScratch = new (lua_newuserdata(InLuaState, sizeof(FLuaStringScratch))) FLuaStringScratch();
+		lua_newtable(InLuaState);
+		lua_pushstring(InLuaState, "__gc");
+		lua_pushcfunction(InLuaState, StringScratchGC);
+		lua_rawset(InLuaState, -3);
+		lua_setmetatable(InLuaState, -2);
+		lua_pushlightuserdata(InLuaState, &StringScratchKey);
+		lua_insert(InLuaState, -2);
+		lua_rawset(InLuaState, LUA_REGISTRYINDEX);
+	}
+	return *pScratch;
+}
+
+static void PushTCharString(lua_State *InLuaState, const TCHAR *Str, int32 Len)
+{ // utf8 straight into the scratch buffer, no temporary conversion object
+	if (Len <= 0)
+	{
+		lua_pushlstring(InLuaState, "", 0);
+		return;
+	}
+
+	TArray<ANSICHAR> &AnsiScratch = GetStringScratch(InLuaState).Ansi;
+	int32 Utf8Len = FTCHARToUTF8_Convert::ConvertedLength(Str, Len);
+	if (AnsiScratch.Num() < Utf8Len)
+	{
+		AnsiScratch.SetNumUninitialized(Utf8Len);
+	}
+
+	FTCHARToUTF8_Convert::Convert(AnsiScratch.GetData(), Utf8Len, Str, Len);
+	lua_pushlstring(InLuaState, AnsiScratch.GetData(), Utf8Len);
+}
+
+static void PushFString(lua_State *InLuaState, const FString &Str)
+{
+	PushTCharString(InLuaState, *Str, Str.Len());
+}
+
+static void PushFName(lua_State *InLuaState, const FName &Name)
+{ // the lua string of a name is built once, then looked up by its display index
+	if (Name.GetNumber() != NAME_NO_NUMBER_INTERNAL)
+	{ // numbered names share the index of their plain name
+		PushFString(InLuaState, Name.ToString());
+		return;
+	}
+
+	lua_pushlightuserdata(InLuaState, &NameCacheKey);
+	lua_rawget(InLuaState, LUA_REGISTRYINDEX);
+	if (!lua_istable(InLuaState, -1))
+	{
+		lua_pop(InLuaState, 1);
+		lua_newtable(InLuaState);
+		lua_pushlightuserdata(InLuaState, &NameCacheKey);
+		lua_pushvalue(InLuaState, -2);
+		lua_rawset(InLuaState, LUA_REGISTRYINDEX);
+	}
+
+	int32 NameIndex = Name.GetDisplayIndex();
+	lua_rawgeti(InLuaState, -1, NameIndex); // cache, string or nil
+	if (lua_isnil(InLuaState, -1))
+	{
+		lua_pop(InLuaState, 1);
+		PushFString(InLuaState, Name.ToString());
+		lua_pushvalue(InLuaState, -1);
+		lua_rawseti(InLuaState, -3, NameIndex);
+	}
+	lua_remove(InLuaState, -2);
+}
+
+static const TCHAR* ToTCharScratch(lua_State *InLuaState, const char *Str, size_t Len)
+{ // valid until the next conversion on the state, callers copy it out right away
+	TArray<TCHAR> &TCharScratch = GetStringScratch(InLuaState).TChar;
+	int32 TCharLen = Len > 0 ? FUTF8ToTCHAR_Convert::ConvertedLength(Str, Len) : 0;
+	if (TCharScratch.Num() < TCharLen + 1)
+	{
+		TCharScratch.SetNumUninitialized(TCharLen + 1);
+	}
+
+	if (TCharLen > 0)
+	{
+		FUTF8ToTCHAR_Convert::Convert(TCharScratch.GetData(), TCharLen, Str, Len);
+	}
+	TCharScratch[TCharLen] = 0;
+	return TCharScratch.GetData();
+}
+
+static void ToFString(const char *Str, size_t Len, FString &OutStr)
+{ // converts into the char array of OutStr, reusing its allocation
+	TArray<TCHAR> &Chars = OutStr.GetCharArray();
+	if (Str == nullptr || Len == 0)
+	{
+		Chars.Reset();
+		return;
+	}
+
+	int32 TCharLen = FUTF8ToTCHAR_Convert::ConvertedLength(Str, Len);
+	Chars.SetNumUninitialized(TCharLen + 1, false);
+	FUTF8ToTCHAR_Convert::Convert(Chars.GetData(), TCharLen, Str, Len);
+	Chars[TCharLen] = 0;
+}
+
 int32 FLuaUtil::Push(lua_State *InLuaState,const FString& value)
 {
-	lua_pushstring(InLuaState, TCHAR_TO_ANSI(*value));
+	PushFString(InLuaState, value);
 	return 1;
 }
 
@@ -363,37 +927,37 @@ int32 FLuaUtil::Push(lua_State *InLuaState, FLuaClassType<const char*> &&value)
 
 int32 FLuaUtil::Push(lua_State *InLuaState, FLuaClassType<FString> &&value)
 {
-	lua_pushstring(InLuaState, TCHAR_TO_ANSI(*value.m_ClassObj));
+	PushFString(InLuaState, value.m_ClassObj);
 	return 1;
 }
 
 int32 FLuaUtil::Push(lua_State *InLuaState, FLuaClassType<FName> &&value)
 {
-	lua_pushstring(InLuaState, TCHAR_TO_ANSI(*value.m_ClassObj.ToString()));
+	PushFName(InLuaState, value.m_ClassObj);
 	return 1;
 }
 
 int32 FLuaUtil::Push(lua_State *InLuaState, FLuaClassType<const FName> &&value)
 {
-	lua_pushstring(InLuaState, TCHAR_TO_ANSI(*value.m_ClassObj.ToString()));
+	PushFName(InLuaState, value.m_ClassObj);
 	return 1;
 }
 
 int32 FLuaUtil::Push(lua_State *InLuaState, FLuaClassType<FText> &&value)
 {
-	lua_pushstring(InLuaState, TCHAR_TO_ANSI(*value.m_ClassObj.ToString()));
+	PushFString(InLuaState, value.m_ClassObj.ToString());
 	return 1;
 }
 
 int32 FLuaUtil::Push(lua_State *InLuaState, FLuaClassType<const FText> &&value)
 {
-	lua_pushstring(InLuaState, TCHAR_TO_ANSI(*value.m_ClassObj.ToString()));
+	PushFString(InLuaState, value.m_ClassObj.ToString());
 	return 1;
 }
 
 int32 FLuaUtil::Push(lua_State *InLuaState, FLuaClassType<const FString> &&value)
 {
-	lua_pushstring(InLuaState, TCHAR_TO_ANSI(*value.m_ClassObj));
+	PushFString(InLuaState, value.m_ClassObj);
 	return 1;
 }
 
@@ -411,13 +975,13 @@ int32 FLuaUtil::Push(lua_State *InLuaState, uint16 value)
 
 int32 FLuaUtil::Push(lua_State *InLuaState, FString&& value)
 {
-	lua_pushstring(InLuaState, TCHAR_TO_ANSI(*value));
+	PushFString(InLuaState, value);
 	return 1;
 }
 
 int32 FLuaUtil::Push(lua_State *InLuaState, FString& value)
 {
-	lua_pushstring(InLuaState, TCHAR_TO_ANSI(*value));
+	PushFString(InLuaState, value);
 	return 1;
 }
 
@@ -427,6 +991,80 @@ int32 FLuaUtil::PushNil(lua_State *InLuaState)
 	return 1;
 }
 
+int32 FLuaUtil::PushRootedObject(lua_State *InLuaState, UObject *pObj, const char *ClassName)
+{ // a cached userdata is already referenced
+	PushObjInner(InLuaState, pObj, ClassName);
+	FLuaUserData *pUserData = ToCppUserData(InLuaState, -1);
+	if (pUserData && pUserData->Ownership == EBorrowed && g_LuaObjectReferencer)
+	{
+		g_LuaObjectReferencer->AddUserData(pUserData);
+		pUserData->Ownership = ERooted;
+	}
+	return 1;
+}
+
+void FLuaUtil::ReleaseUserData(lua_State *InLuaState, int32 LuaStackIndex)
+{
+	FLuaUserData *pUserData = ToCppUserData(InLuaState, LuaStackIndex);
+	if (pUserData == nullptr || pUserData->pObj == nullptr)
+	{
+		return;
+	}
+
+	if (pUserData->Ownership == EBorrowed)
+	{
+		TemplateLogWarning(TEXT("ReleaseUserData: the object is not owned by lua"));
+		return;
+	}
+
+	if (pUserData->Ownership == ERooted)
+	{ // the address may be reused, drop it from the userdata cache
+		lua_getmetatable(InLuaState, LuaStackIndex);
+		lua_pushlightuserdata(InLuaState, &UserDataCacheKey);
+		lua_rawget(InLuaState, -2);
+		lua_pushlightuserdata(InLuaState, pUserData->pObj);
+		lua_pushnil(InLuaState);
+		lua_rawset(InLuaState, -3);
+		lua_pop(InLuaState, 2);
+	}
+
+	ReleaseOwnedObject(pUserData);
+	pUserData->pObj = nullptr;
+}
+
+void FLuaUtil::SetOwner(lua_State *InLuaState, int32 LuaStackIndex, int32 OwnerIndex)
+{ // owners[member] = owner, the entry goes with the member userdata. borrowed owners are recorded too, they may have an owner of their own
+	if (!lua_isuserdata(InLuaState, LuaStackIndex) || !lua_isuserdata(InLuaState, OwnerIndex))
+	{
+		return;
+	}
+
+	int32 Top = lua_gettop(InLuaState);
+	LuaStackIndex = LuaStackIndex > 0 ? LuaStackIndex : Top + LuaStackIndex + 1;
+	OwnerIndex = OwnerIndex > 0 ? OwnerIndex : Top + OwnerIndex + 1;
+
+	lua_pushlightuserdata(InLuaState, &OwnerTableKey);
+	lua_rawget(InLuaState, LUA_REGISTRYINDEX);
+	if (!lua_istable(InLuaState, -1))
+	{
+		lua_pop(InLuaState, 1);
+		lua_newtable(InLuaState);
+		lua_newtable(InLuaState);
+		lua_pushstring(InLuaState, "__mode");
+		lua_pushstring(InLuaState, "k");
+		lua_rawset(InLuaState, -3);
+		lua_setmetatable(InLuaState, -2);
+		lua_pushlightuserdata(InLuaState, &OwnerTableKey);
+		lua_pushvalue(InLuaState, -2);
+		lua_rawset(InLuaState, LUA_REGISTRYINDEX);
+	}
+
+	lua_pushvalue(InLuaState, LuaStackIndex);
+	lua_pushvalue(InLuaState, OwnerIndex);
+	lua_rawset(InLuaState, -3);
+	lua_settop(InLuaState, Top);
+}
+
 void FLuaUtil::TouserData(lua_State *InLuaState, const int32 LuaStackIndex, uint8 &ReturnValue)
 {
 	ReturnValue = lua_tointeger(InLuaState, LuaStackIndex);
@@ -459,17 +1097,23 @@ void FLuaUtil::TouserData(lua_State *InLuaState, const int32 LuaStackIndex, bool
 
 void FLuaUtil::TouserData(lua_State *InLuaState, const int32 LuaStackIndex, FText &ReturnValue)
 {
-	ReturnValue = FText::FromString(luaL_checkstring(InLuaState, LuaStackIndex));
+	size_t Len = 0;
+	const char *Str = luaL_checklstring(InLuaState, LuaStackIndex, &Len);
+	ReturnValue = FText::FromString(FString(ToTCharScratch(InLuaState, Str, Len)));
 }
 
 void FLuaUtil::TouserData(lua_State *InLuaState, const int32 LuaStackIndex, FName &ReturnValue)
 {
-	ReturnValue = FName(luaL_checkstring(InLuaState, LuaStackIndex));
+	size_t Len = 0;
+	const char *Str = luaL_checklstring(InLuaState, LuaStackIndex, &Len);
+	ReturnValue = FName(ToTCharScratch(InLuaState, Str, Len));
 }
 
 void FLuaUtil::TouserData(lua_State *InLuaState, const int32 LuaStackIndex, FString &ReturnValue)
 {
-	ReturnValue = FString(ANSI_TO_TCHAR(luaL_checkstring(InLuaState, LuaStackIndex)));
+	size_t Len = 0;
+	const char *Str = luaL_checklstring(InLuaState, LuaStackIndex, &Len);
+	ToFString(Str, Len, ReturnValue);
 }
 
 void FLuaUtil::TouserData(lua_State *InLuaState, const int32 LuaStackIndex, int32 &ReturnValue)
@@ -514,17 +1158,23 @@ void FLuaUtil::TouserData(lua_State *InLuaState, const int32 LuaStackIndex, FLua
 
 void FLuaUtil::TouserData(lua_State *InLuaState, const int32 LuaStackIndex, FLuaClassType<FText> &&ReturnValue)
 {
-	ReturnValue.m_ClassObj = FText::FromString(ANSI_TO_TCHAR(lua_tostring(InLuaState, LuaStackIndex)));
+	size_t Len = 0;
+	const char *Str = lua_tolstring(InLuaState, LuaStackIndex, &Len);
+	ReturnValue.m_ClassObj = FText::FromString(FString(ToTCharScratch(InLuaState, Str, Len)));
 }
 
 void FLuaUtil::TouserData(lua_State *InLuaState, const int32 LuaStackIndex, FLuaClassType<FName> &&ReturnValue)
 {
-	ReturnValue.m_ClassObj = FName(ANSI_TO_TCHAR(lua_tostring(InLuaState, LuaStackIndex)));
+	size_t Len = 0;
+	const char *Str = lua_tolstring(InLuaState, LuaStackIndex, &Len);
+	ReturnValue.m_ClassObj = FName(ToTCharScratch(InLuaState, Str, Len));
 }
 
 void FLuaUtil::TouserData(lua_State *InLuaState, const int32 LuaStackIndex, FLuaClassType<FString> &&ReturnValue)
 {
-	ReturnValue.m_ClassObj = FString(ANSI_TO_TCHAR(lua_tostring(InLuaState, LuaStackIndex)));
+	size_t Len = 0;
+	const char *Str = lua_tolstring(InLuaState, LuaStackIndex, &Len);
+	ToFString(Str, Len, ReturnValue.m_ClassObj);
 }
 
 int32 LuaErrHandleFunc(lua_State*LuaState)
@@ -549,3 +1199,112 @@ int32 LuaErrHandleFunc(lua_State*LuaState)
 	}
 	return 1;
 }
+
+static int32 GetErrorHandlerRef(lua_State *InLuaState)
+{ // one LuaErrHandleFunc closure per state, shared by every FLuaFunctionRef
+	lua_pushlightuserdata(InLuaState, &ErrorHandlerRefKey);
+	lua_rawget(InLuaState, LUA_REGISTRYINDEX);
+	int32 Ref = lua_isnumber(InLuaState, -1) ? (int32)lua_tointeger(InLuaState, -1) : LUA_NOREF;
+	lua_pop(InLuaState, 1);
+	if (Ref == LUA_NOREF)
+	{
+		lua_pushcfunction(InLuaState, LuaErrHandleFunc);
+		Ref = luaL_ref(InLuaState, LUA_REGISTRYINDEX);
+		lua_pushlightuserdata(InLuaState, &ErrorHandlerRefKey);
+		lua_pushinteger(InLuaState, Ref);
+		lua_rawset(InLuaState, LUA_REGISTRYINDEX);
+	}
+	return Ref;
+}
+
+FLuaFunctionRef::FLuaFunctionRef()
+	: m_StateGeneration(0)
+	, m_FuncRef(LUA_NOREF)
+	, m_ErrorHandlerRef(LUA_NOREF)
+{
+
+}
+
+FLuaFunctionRef::FLuaFunctionRef(const char *FuncName)
+	: FLuaFunctionRef()
+{
+	if (g_LuaState)
+	{
+		lua_getfield(g_LuaState, LUA_GLOBALSINDEX, FuncName);
+		Init(g_LuaState, -1);
+		lua_pop(g_LuaState, 1);
+	}
+}
+
+FLuaFunctionRef::FLuaFunctionRef(const FString &FuncName)
+	: FLuaFunctionRef(TCHAR_TO_ANSI(*FuncName))
+{
+
+}
+
+FLuaFunctionRef::FLuaFunctionRef(lua_State *InLuaState, int32 LuaStackIndex)
+	: FLuaFunctionRef()
+{
+	Init(InLuaState, LuaStackIndex);
+}
+
+FLuaFunctionRef::FLuaFunctionRef(FLuaFunctionRef &&Other)
+	: m_StateGeneration(Other.m_StateGeneration)
+	, m_FuncRef(Other.m_FuncRef)
+	, m_ErrorHandlerRef(Other.m_ErrorHandlerRef)
+{
+	Other.m_FuncRef = LUA_NOREF;
+}
+
+FLuaFunctionRef& FLuaFunctionRef::operator=(FLuaFunctionRef &&Other)
+{
+	if (this != &Other)
+	{
+		Reset();
+		m_StateGeneration = Other.m_StateGeneration;
+		m_FuncRef = Other.m_FuncRef;
+		m_ErrorHandlerRef = Other.m_ErrorHandlerRef;
+		Other.m_FuncRef = LUA_NOREF;
+	}
+	return *this;
+}
+
+FLuaFunctionRef::~FLuaFunctionRef()
+{
+	Reset();
+}
+
+void FLuaFunctionRef::Init(lua_State *InLuaState, int32 LuaStackIndex)
+{
+	if (!lua_isfunction(InLuaState, LuaStackIndex))
+	{
+		FLuaUtil::TemplateLogError(FString::Printf(TEXT("FLuaFunctionRef: not a function, %s"), ANSI_TO_TCHAR(luaL_typename(InLuaState, LuaStackIndex))));
+		return;
+	}
+
+	lua_pushvalue(InLuaState, LuaStackIndex);
+	m_FuncRef = luaL_ref(InLuaState, LUA_REGISTRYINDEX);
+	m_ErrorHandlerRef = GetErrorHandlerRef(InLuaState);
+	m_StateGeneration = g_LuaStateGeneration;
+}
+
+void FLuaFunctionRef::Reset()
+{ // the refs of a closed state are gone with it
+	if (IsValid())
+	{
+		luaL_unref(g_LuaState, LUA_REGISTRYINDEX, m_FuncRef);
+	}
+	m_FuncRef = LUA_NOREF;
+}
+
+bool FLuaFunctionRef::Push(lua_State *InLuaState) const
+{
+	if (!IsValid())
+	{
+		return false;
+	}
+
+	lua_rawgeti(InLuaState, LUA_REGISTRYINDEX, m_ErrorHandlerRef);
+	lua_rawgeti(InLuaState, LUA_REGISTRYINDEX, m_FuncRef);
+	return true;
+}
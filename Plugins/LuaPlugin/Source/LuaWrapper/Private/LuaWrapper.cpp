@@ -2,8 +2,12 @@
 #include "Core.h"
 #include "LuaUtil.h"
 #include "LuaWrapperDefine.h"
-#include "AllHeaders.h"
 #include "LoadAllDefine.h"
+#include "LuaObjectReferencer.h"
+#include "LuaScriptLoader.h"
+#include "LuaAllocator.h"
+#include "LuaGCScheduler.h"
+#include "LuaProfiler.h"
 
 FLuaWrapper::FLuaWrapper()
 {
@@ -29,28 +33,39 @@ void FLuaWrapper::Init()
 	DoMainFile();
 }
 
-void FLuaWrapper::InitLuaEnv()
+static int32 LuaPanic(lua_State *InLuaState)
 {
-	g_LuaState = lua_open();
-	luaL_openlibs(g_LuaState);
-	InitGlobalTable();
+	LuaWrapperLog(Fatal, TEXT("unprotected error in call to Lua API (%s)"), UTF8_TO_TCHAR(lua_tostring(InLuaState, -1)));
+	return 0;
 }
 
-void FLuaWrapper::InitGlobalTable()
+void FLuaWrapper::InitLuaEnv()
 {
-	{ 
-		lua_newtable(g_LuaState); // table1
-		//lua_newtable(m_LuaState); // table2
-// 		lua_pushstring(m_LuaState, "v");
-// 		lua_setfield(m_LuaState, -2, "__mode"); //  set table2 value is weak 
-		//lua_setmetatable(m_LuaState, -2); // table1[metatable] = table2
-		lua_setfield(g_LuaState, LUA_REGISTRYINDEX, "_existuserdata"); // LUA_REGISTRYINDEX[_existuserdata] = table1
-	}
+	g_LuaObjectReferencer = new FLuaObjectReferencer();
+	g_LuaAllocator = new FLuaAllocator();
+	g_LuaState = lua_newstate(FLuaAllocator::LuaAlloc, g_LuaAllocator);
+	++g_LuaStateGeneration;
+	lua_atpanic(g_LuaState, LuaPanic);
+	luaL_openlibs(g_LuaState);
+	FLuaAllocator::RegisterStats(g_LuaState);
+	g_LuaGCScheduler = new FLuaGCScheduler(g_LuaState);
+	g_LuaProfiler = new FLuaProfiler(g_LuaState);
+	FLuaScriptLoader::InstallRequireLoader(g_LuaState);
 }
 
 void FLuaWrapper::CloseLuaEnv()
 {
-	lua_close(g_LuaState);
+	delete g_LuaProfiler;
+	g_LuaProfiler = nullptr;
+	delete g_LuaGCScheduler;
+	g_LuaGCScheduler = nullptr;
+	lua_close(g_LuaState); // __gc of every userdata drops its reference
+	g_LuaState = nullptr;
+	FLuaUtil::ResetLazyClasses();
+	delete g_LuaObjectReferencer;
+	g_LuaObjectReferencer = nullptr;
+	delete g_LuaAllocator;
+	g_LuaAllocator = nullptr;
 }
 
 static int32 LuaUnrealLog(lua_State* LuaState)
@@ -83,15 +98,24 @@ void FLuaWrapper::RegisterLuaLog()
 }
 
 void FLuaWrapper::RegisterAllClasses()
-{
-	Def_LoadAll(g_LuaState);
+{ // eager by default, set [LuaWrapper] bLazyRegisterClasses=True in DefaultGame.ini to register classes on first use
+	bool bLazyRegisterClasses = false;
+	GConfig->GetBool(TEXT("LuaWrapper"), TEXT("bLazyRegisterClasses"), bLazyRegisterClasses, GGameIni);
+
+	if (bLazyRegisterClasses)
+	{
+		Def_LazyLoadAll(g_LuaState);
+	}
+	else
+	{
+		Def_LoadAll(g_LuaState);
+	}
 }
 
 void FLuaWrapper::DoMainFile()
 {
-	FString luaDir = FPaths::ConvertRelativePathToFull(FPaths::GameDir() / TEXT("LuaSource"));
-	FString LuaMainFile = luaDir / TEXT("main.lua");
-	if (luaL_dofile(g_LuaState, TCHAR_TO_ANSI(*LuaMainFile)))
+	FString LuaMainFile = FLuaScriptLoader::GetSourceDir() / TEXT("main.lua");
+	if (FLuaScriptLoader::LoadFile(g_LuaState, LuaMainFile) || lua_pcall(g_LuaState, 0, LUA_MULTRET, 0))
 	{
 		LuaWrapperLog(Fatal, TEXT("DoMainFile error %s!"),ANSI_TO_TCHAR(lua_tostring(g_LuaState, -1)));
 	}
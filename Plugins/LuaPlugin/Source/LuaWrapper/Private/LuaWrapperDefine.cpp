@@ -2,4 +2,9 @@
 DEFINE_LOG_CATEGORY(LogLua);
 
 lua_State  *g_LuaState = nullptr;
-FLuaWrapper *g_LuaWrapper = nullptr;
\ No newline at end of file
+uint32 g_LuaStateGeneration = 0;
+FLuaWrapper *g_LuaWrapper = nullptr;
+FLuaObjectReferencer *g_LuaObjectReferencer = nullptr;
+FLuaAllocator *g_LuaAllocator = nullptr;
+FLuaGCScheduler *g_LuaGCScheduler = nullptr;
+FLuaProfiler *g_LuaProfiler = nullptr;
\ No newline at end of file
@@ -1,12 +1,15 @@
 #include "LuaWrapperModule.h"
 #include "LuaWrapper.h"
 #include "LuaWrapperDefine.h"
+#include "LuaScriptPack.h"
 
 #define LOCTEXT_NAMESPACE "FLuaWrapperModule"
 
 void FLuaWrapperModule::StartupModule()
 {
-	
+#if WITH_EDITOR
+	FLuaScriptPack::RegisterCookHook();
+#endif
 }
 
 void FLuaWrapperModule::ShutdownModule()
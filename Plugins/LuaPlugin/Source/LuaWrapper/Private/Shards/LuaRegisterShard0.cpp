@@ -0,0 +1,2 @@
+// one slice of the exported classes, the generator writes the content into LuaRegisterShard0.script.h
+#include "LuaRegisterShard0.script.h"
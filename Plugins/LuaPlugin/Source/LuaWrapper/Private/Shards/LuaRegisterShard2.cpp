@@ -0,0 +1,2 @@
+// one slice of the exported classes, the generator writes the content into LuaRegisterShard2.script.h
+#include "LuaRegisterShard2.script.h"
@@ -0,0 +1,2 @@
+// one slice of the exported classes, the generator writes the content into LuaRegisterShard3.script.h
+#include "LuaRegisterShard3.script.h"
@@ -0,0 +1,2 @@
+// one slice of the exported classes, the generator writes the content into LuaRegisterShard4.script.h
+#include "LuaRegisterShard4.script.h"
@@ -0,0 +1,2 @@
+// one slice of the exported classes, the generator writes the content into LuaRegisterShard7.script.h
+#include "LuaRegisterShard7.script.h"
@@ -0,0 +1,50 @@
+#pragma once
+#include "CoreMinimal.h"
+#include "LuaWrapperDefine.h"
+
+// lua_Alloc of the lua state, small blocks come from per size class free lists carved out of pages,
+// the rest goes to FMemory. lua passes the old size back on free, so blocks carry no header
+class LUAWRAPPER_API FLuaAllocator
+{
+public:
+	enum { SizeClassNum = 12 };
+
+	struct FStats
+	{
+		int64 TotalBytes; // requested by lua
+		int64 PageBytes;
+		int64 LargeBytes;
+		int32 LargeBlocks;
+		int32 LiveBlocks[SizeClassNum];
+		int32 FreeBlocks[SizeClassNum];
+	};
+
+public:
+	FLuaAllocator();
+	~FLuaAllocator();
+
+public:
+	static void* LuaAlloc(void *pUserData, void *ptr, size_t OldSize, size_t NewSize);
+	static int32 GetSizeClassSize(int32 SizeClass);
+	static void RegisterStats(lua_State *InLuaState); // LuaMemory.GetStats()
+
+public:
+	const FStats& GetStats() const { return m_Stats; }
+	void LogStats() const;
+
+private:
+	void* Alloc(size_t Size);
+	void Free(void *ptr, size_t Size);
+	void* Realloc(void *ptr, size_t OldSize, size_t NewSize);
+	void AllocPage(int32 SizeClass);
+
+private:
+	struct FFreeBlock
+	{
+		FFreeBlock *pNext;
+	};
+
+	FFreeBlock *m_FreeLists[SizeClassNum];
+	TArray<void*> m_Pages;
+	FStats m_Stats;
+};
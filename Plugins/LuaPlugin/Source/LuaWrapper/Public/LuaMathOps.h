@@ -0,0 +1,161 @@
+#pragma once
+
+// operators of the structs listed in [MathStructs] of LuaConfig.ini, bound by the generated
+// __add/__sub/__mul/__eq and XxxInPlace functions. results are pushed as inline values, the in place
+// versions write into the first operand and return it. operators T lacks raise a lua error
+template <class T>
+struct TLuaMathOps
+{
+public:
+	static int32 Add(lua_State *InLuaState, const char *ClassName)
+	{
+		T *pA = ToStruct(InLuaState, 1, ClassName);
+		T *pB = ToStruct(InLuaState, 2, ClassName);
+		return pA && pB ? AddImpl(InLuaState, *pA, *pB, ClassName, 0) : ArgError(InLuaState, "__add", ClassName);
+	}
+
+	static int32 Sub(lua_State *InLuaState, const char *ClassName)
+	{
+		T *pA = ToStruct(InLuaState, 1, ClassName);
+		T *pB = ToStruct(InLuaState, 2, ClassName);
+		return pA && pB ? SubImpl(InLuaState, *pA, *pB, ClassName, 0) : ArgError(InLuaState, "__sub", ClassName);
+	}
+
+	static int32 Mul(lua_State *InLuaState, const char *ClassName)
+	{ // v * s, s * v and v * v
+		int32 StructIndex = lua_type(InLuaState, 1) == LUA_TNUMBER ? 2 : 1;
+		int32 OtherIndex = 3 - StructIndex;
+		T *pA = ToStruct(InLuaState, StructIndex, ClassName);
+		if (pA && lua_type(InLuaState, OtherIndex) == LUA_TNUMBER)
+		{
+			return ScaleImpl(InLuaState, *pA, (float)lua_tonumber(InLuaState, OtherIndex), ClassName, 0);
+		}
+
+		T *pB = ToStruct(InLuaState, OtherIndex, ClassName);
+		return pA && pB ? MulImpl(InLuaState, *pA, *pB, ClassName, 0) : ArgError(InLuaState, "__mul", ClassName);
+	}
+
+	static int32 Eq(lua_State *InLuaState, const char *ClassName)
+	{
+		T *pA = ToStruct(InLuaState, 1, ClassName);
+		T *pB = ToStruct(InLuaState, 2, ClassName);
+		return pA && pB ? EqImpl(InLuaState, *pA, *pB, ClassName, 0) : ArgError(InLuaState, "__eq", ClassName);
+	}
+
+	static int32 AddInPlace(lua_State *InLuaState, const char *ClassName)
+	{
+		T *pA = ToStruct(InLuaState, 1, ClassName);
+		T *pB = ToStruct(InLuaState, 2, ClassName);
+		return pA && pB ? AddInPlaceImpl(InLuaState, *pA, *pB, ClassName, 0) : ArgError(InLuaState, "AddInPlace", ClassName);
+	}
+
+	static int32 SubInPlace(lua_State *InLuaState, const char *ClassName)
+	{
+		T *pA = ToStruct(InLuaState, 1, ClassName);
+		T *pB = ToStruct(InLuaState, 2, ClassName);
+		return pA && pB ? SubInPlaceImpl(InLuaState, *pA, *pB, ClassName, 0) : ArgError(InLuaState, "SubInPlace", ClassName);
+	}
+
+	static int32 MulInPlace(lua_State *InLuaState, const char *ClassName)
+	{
+		T *pA = ToStruct(InLuaState, 1, ClassName);
+		if (pA && lua_type(InLuaState, 2) == LUA_TNUMBER)
+		{
+			return ScaleInPlaceImpl(InLuaState, *pA, (float)lua_tonumber(InLuaState, 2), ClassName, 0);
+		}
+
+		T *pB = ToStruct(InLuaState, 2, ClassName);
+		return pA && pB ? MulInPlaceImpl(InLuaState, *pA, *pB, ClassName, 0) : ArgError(InLuaState, "MulInPlace", ClassName);
+	}
+
+private:
+	static T* ToStruct(lua_State *InLuaState, int32 LuaStackIndex, const char *ClassName)
+	{
+		return lua_isuserdata(InLuaState, LuaStackIndex) ? FLuaUtil::TouserData<T*>(InLuaState, LuaStackIndex, ClassName) : nullptr;
+	}
+
+	static int32 ArgError(lua_State *InLuaState, const char *FuncName, const char *ClassName)
+	{
+		return luaL_error(InLuaState, "%s.%s: wrong operands", ClassName, FuncName);
+	}
+
+	static int32 OpError(lua_State *InLuaState, const char *FuncName, const char *ClassName)
+	{
+		return luaL_error(InLuaState, "%s.%s: not supported by the struct", ClassName, FuncName);
+	}
+
+	static int32 PushSelf(lua_State *InLuaState)
+	{
+		lua_pushvalue(InLuaState, 1);
+		return 1;
+	}
+
+	// the int32 overloads exist only when T has the operator, the variadic ones catch the rest
+	template <class U>
+	static auto AddImpl(lua_State *InLuaState, const U &A, const U &B, const char *ClassName, int32) -> decltype(T(A + B), int32())
+	{
+		return FLuaUtil::Push(InLuaState, FLuaValueType<T>(T(A + B), ClassName));
+	}
+	static int32 AddImpl(lua_State *InLuaState, const T &A, const T &B, const char *ClassName, ...) { return OpError(InLuaState, "__add", ClassName); }
+
+	template <class U>
+	static auto SubImpl(lua_State *InLuaState, const U &A, const U &B, const char *ClassName, int32) -> decltype(T(A - B), int32())
+	{
+		return FLuaUtil::Push(InLuaState, FLuaValueType<T>(T(A - B), ClassName));
+	}
+	static int32 SubImpl(lua_State *InLuaState, const T &A, const T &B, const char *ClassName, ...) { return OpError(InLuaState, "__sub", ClassName); }
+
+	template <class U>
+	static auto MulImpl(lua_State *InLuaState, const U &A, const U &B, const char *ClassName, int32) -> decltype(T(A * B), int32())
+	{
+		return FLuaUtil::Push(InLuaState, FLuaValueType<T>(T(A * B), ClassName));
+	}
+	static int32 MulImpl(lua_State *InLuaState, const T &A, const T &B, const char *ClassName, ...) { return OpError(InLuaState, "__mul", ClassName); }
+
+	template <class U>
+	static auto ScaleImpl(lua_State *InLuaState, const U &A, float Scale, const char *ClassName, int32) -> decltype(T(A * Scale), int32())
+	{
+		return FLuaUtil::Push(InLuaState, FLuaValueType<T>(T(A * Scale), ClassName));
+	}
+	static int32 ScaleImpl(lua_State *InLuaState, const T &A, float Scale, const char *ClassName, ...) { return OpError(InLuaState, "__mul", ClassName); }
+
+	template <class U>
+	static auto EqImpl(lua_State *InLuaState, const U &A, const U &B, const char *ClassName, int32) -> decltype(bool(A == B), int32())
+	{
+		lua_pushboolean(InLuaState, A == B);
+		return 1;
+	}
+	static int32 EqImpl(lua_State *InLuaState, const T &A, const T &B, const char *ClassName, ...) { return OpError(InLuaState, "__eq", ClassName); }
+
+	template <class U>
+	static auto AddInPlaceImpl(lua_State *InLuaState, U &A, const U &B, const char *ClassName, int32) -> decltype(A += B, int32())
+	{
+		A += B;
+		return PushSelf(InLuaState);
+	}
+	static int32 AddInPlaceImpl(lua_State *InLuaState, T &A, const T &B, const char *ClassName, ...) { return OpError(InLuaState, "AddInPlace", ClassName); }
+
+	template <class U>
+	static auto SubInPlaceImpl(lua_State *InLuaState, U &A, const U &B, const char *ClassName, int32) -> decltype(A -= B, int32())
+	{
+		A -= B;
+		return PushSelf(InLuaState);
+	}
+	static int32 SubInPlaceImpl(lua_State *InLuaState, T &A, const T &B, const char *ClassName, ...) { return OpError(InLuaState, "SubInPlace", ClassName); }
+
+	template <class U>
+	static auto MulInPlaceImpl(lua_State *InLuaState, U &A, const U &B, const char *ClassName, int32) -> decltype(A *= B, int32())
+	{
+		A *= B;
+		return PushSelf(InLuaState);
+	}
+	static int32 MulInPlaceImpl(lua_State *InLuaState, T &A, const T &B, const char *ClassName, ...) { return OpError(InLuaState, "MulInPlace", ClassName); }
+
+	template <class U>
+	static auto ScaleInPlaceImpl(lua_State *InLuaState, U &A, float Scale, const char *ClassName, int32) -> decltype(A *= Scale, int32())
+	{
+		A *= Scale;
+		return PushSelf(InLuaState);
+	}
+	static int32 ScaleInPlaceImpl(lua_State *InLuaState, T &A, float Scale, const char *ClassName, ...) { return OpError(InLuaState, "MulInPlace", ClassName); }
+};
@@ -1,5 +1,7 @@
 #pragma once
 #include "LuaWrapperDefine.h"
+#include "Templates/Tuple.h"
+#include "Templates/IntegerSequence.h"
 
 int LuaErrHandleFunc(lua_State*InLuaState);
 
@@ -33,6 +35,47 @@ public:
 	int32 m_num;
 };
 
+// what __gc does with the object of a userdata
+enum ELuaOwnership
+{
+	EBorrowed, // owned by cpp, nothing to do
+	EOwned, // value stored inline after the userdata block, Destructor releases it
+	ERooted, // UObject referenced by g_LuaObjectReferencer, reference removed
+};
+
+// memory block of every userdata pushed by FLuaUtil
+struct FLuaUserData
+{
+	void *pObj;
+	int32 ClassId; // preorder index in the exported class tree, children follow their parent
+	int32 ClassIdEnd; // one past the last child id
+	void (*Destructor)(void *pValue);
+	uint8 Ownership; // ELuaOwnership
+	int32 ReferenceIndex; // index in g_LuaObjectReferencer for rooted objects
+};
+
+// everything RegisterClass needs for one class, kept until the class is first used
+struct FLuaClassRegInfo
+{
+	const char *ClassName;
+	const luaL_Reg *ClassFunctions;
+	const luaL_Reg *PropertyGetters;
+	const luaL_Reg *PropertySetters;
+	int32 ClassId;
+	int32 ClassIdEnd;
+};
+
+// class id range of T, resolved from the class metatable on first use
+template <class T>
+struct TLuaClassId
+{
+	static int32 ClassId;
+	static int32 ClassIdEnd; // 0 means not resolved yet
+};
+
+template <class T> int32 TLuaClassId<T>::ClassId = INDEX_NONE;
+template <class T> int32 TLuaClassId<T>::ClassIdEnd = 0;
+
 template <class T>
 class LUAWRAPPER_API FLuaClassType
 {
@@ -48,10 +91,91 @@ public:
 	const char *m_ClassName;
 };
 
+// value pushed by copy, stored inside the userdata block instead of on the heap
+template <class T>
+class LUAWRAPPER_API FLuaValueType
+{
+public:
+	explicit FLuaValueType(T &&Value, const char *ClassName)
+		:m_Value(Value)
+		,m_ClassName(ClassName)
+	{
+	}
+
+public:
+	T &m_Value;
+	const char *m_ClassName;
+};
+
+// argument of CallRTuple assigned back after the call, lua returns the out params after its results
+template <class T>
+class FLuaOutParam
+{
+public:
+	explicit FLuaOutParam(T &Value)
+		:m_Value(Value)
+	{
+	}
+
+public:
+	T &m_Value;
+};
+
+template <class T>
+FLuaOutParam<T> LuaOut(T &Value)
+{
+	return FLuaOutParam<T>(Value);
+}
+
+template <class T> struct TLuaIsOutParam { enum { Value = 0 }; };
+template <class T> struct TLuaIsOutParam<FLuaOutParam<T>> { enum { Value = 1 }; };
+
+template <class... T> struct TLuaOutParamNum { enum { Value = 0 }; };
+template <class T1, class... T> struct TLuaOutParamNum<T1, T...> { enum { Value = TLuaIsOutParam<typename TDecay<T1>::Type>::Value + TLuaOutParamNum<T...>::Value }; };
+
+// a lua function resolved once into the registry together with the error handler,
+// for callbacks called every tick. resolve it again after FLuaWrapper::Restart
+class LUAWRAPPER_API FLuaFunctionRef
+{
+public:
+	FLuaFunctionRef();
+	explicit FLuaFunctionRef(const char *FuncName); // global function of g_LuaState
+	explicit FLuaFunctionRef(const FString &FuncName);
+	FLuaFunctionRef(lua_State *InLuaState, int32 LuaStackIndex);
+	FLuaFunctionRef(FLuaFunctionRef &&Other);
+	FLuaFunctionRef& operator=(FLuaFunctionRef &&Other);
+	~FLuaFunctionRef();
+
+	FLuaFunctionRef(const FLuaFunctionRef&) = delete;
+	FLuaFunctionRef& operator=(const FLuaFunctionRef&) = delete;
+
+public:
+	bool IsValid() const { return m_FuncRef != LUA_NOREF && m_StateGeneration == g_LuaStateGeneration; }
+	void Reset();
+	bool Push(lua_State *InLuaState) const; // error handler then function, nothing pushed if not valid
+
+private:
+	void Init(lua_State *InLuaState, int32 LuaStackIndex);
+
+private:
+	uint32 m_StateGeneration; // refs live in the registry shared by every thread of the state
+	int32 m_FuncRef;
+	int32 m_ErrorHandlerRef;
+};
+
 class LUAWRAPPER_API FLuaUtil
 {
 public:
 	static void RegisterClass(lua_State *InLuaState, const luaL_Reg ClassFunctions[], const char *ClassName);
+	static void RegisterClass(lua_State *InLuaState, const luaL_Reg ClassFunctions[], const luaL_Reg PropertyGetters[], const luaL_Reg PropertySetters[], const char *ClassName, int32 ClassId, int32 ClassIdEnd);
+
+	// ClassRegInfos sorted by ClassName, a class is registered when its global or metatable is first needed.
+	// globals resolve through __index of the metatable of _G, an existing __index is chained.
+	// a script replacing the metatable of _G afterwards (strict.lua) has to chain the old __index itself,
+	// or classes are only registered when an object of them is pushed
+	static void RegisterLazyClasses(lua_State *InLuaState, const FLuaClassRegInfo ClassRegInfos[], int32 ClassNum);
+	static bool RegisterLazyClass(lua_State *InLuaState, const char *ClassName);
+	static void ResetLazyClasses(); // the state is closed, forget its tables
 
 public: // call functions 
 	template <class... T>
@@ -66,6 +190,12 @@ public: // call functions
 		CallRImpl(FLuaReturnTypeNum(0), FLuaFuncName(FuncName), Forward<T>(args)...);
 	}
 
+	template <class... T>
+	static void Call(const FLuaFunctionRef &Func, T&&... args)
+	{
+		CallRImpl(FLuaReturnTypeNum(0), Func, Forward<T>(args)...);
+	}
+
 public: // call function with return
 	template <class... T>
 	static void CallR(T&&... args)
@@ -73,6 +203,77 @@ public: // call function with return
 		CallRImpl(FLuaReturnTypeNum(0), Forward<T>(args)...);
 	}
 
+	// every result and out param read from fixed stack indices, then one pop for all of them
+	// int32 Sum; float Scale; Tie(Sum, Scale) = FLuaUtil::CallRTuple<int32, float>("Func", 1, LuaOut(Value));
+	template <class... R, class FuncType, class... T>
+	static TTuple<R...> CallRTuple(const FuncType &Func, T&&... args)
+	{
+		const int32 ResultNum = sizeof...(R);
+		TTuple<R...> Results(R()...);
+		int32 Top = LuaGetTop(g_LuaState);
+		if (!PushCallee(g_LuaState, Func))
+		{
+			TemplateLogError(TEXT("call r tuple with an invalid function!!!"));
+			return Results;
+		}
+
+		int32 paramCount = Push(g_LuaState, Forward<T>(args)...);
+		if (LuaPCall(g_LuaState, paramCount, ResultNum + TLuaOutParamNum<T...>::Value, -(paramCount + 2)))
+		{
+			FString log = FString::Printf(TEXT("call r tuple found an error: %s!!!"), ANSI_TO_TCHAR(LuaToString(g_LuaState, -1)));
+			TemplateLogError(log);
+		}
+		else
+		{ // Top + 1 is the error handler
+			ReadResults(g_LuaState, Top + 2, Results, TMakeIntegerSequence<uint32, sizeof...(R)>());
+			ReadOutParams(g_LuaState, Top + 2 + ResultNum, Forward<T>(args)...);
+		}
+		LuaSetTop(g_LuaState, Top);
+		return Results;
+	}
+
+private:
+	static bool PushCallee(lua_State *InLuaState, const char *FuncName)
+	{
+		LuaPushErrorFunc(InLuaState);
+		LuaGetFiled(InLuaState, LUA_GLOBALSINDEX, FuncName);
+		return true;
+	}
+
+	static bool PushCallee(lua_State *InLuaState, const FString &FuncName)
+	{
+		return PushCallee(InLuaState, TCHAR_TO_ANSI(*FuncName));
+	}
+
+	static bool PushCallee(lua_State *InLuaState, const FLuaFunctionRef &Func)
+	{
+		return Func.Push(InLuaState);
+	}
+
+	template <class... R, uint32... Indices>
+	static void ReadResults(lua_State *InLuaState, int32 LuaStackIndex, TTuple<R...> &Results, TIntegerSequence<uint32, Indices...>)
+	{
+		int32 Expand[] = { 0, (TouserData(InLuaState, LuaStackIndex + Indices, Results.template Get<Indices>()), 0)... };
+		(void)Expand;
+	}
+
+	static void ReadOutParams(lua_State *InLuaState, int32 LuaStackIndex)
+	{
+	}
+
+	template <class T1, class... T>
+	static void ReadOutParams(lua_State *InLuaState, int32 LuaStackIndex, T1 &&Value, T&&... args)
+	{
+		ReadOutParams(InLuaState, LuaStackIndex, Forward<T>(args)...);
+	}
+
+	template <class T1, class... T>
+	static void ReadOutParams(lua_State *InLuaState, int32 LuaStackIndex, FLuaOutParam<T1> &&Value, T&&... args)
+	{
+		TouserData(InLuaState, LuaStackIndex, Value.m_Value);
+		ReadOutParams(InLuaState, LuaStackIndex + 1, Forward<T>(args)...);
+	}
+
 private:
 	template <class... T>
 	static void CallRImpl(FLuaReturnTypeNum &&RetTypeNum, FLuaFuncName &&Value, T&&... args)
@@ -84,7 +285,45 @@ private:
 		{
 			FString log = FString::Printf(TEXT("call r impl found an error: %s!!!"), ANSI_TO_TCHAR(LuaToString(g_LuaState, -1)));
 			TemplateLogError(log);
+			LuaPop(g_LuaState, 2);
+			PushNils(g_LuaState, RetTypeNum.m_num);
+			return;
+		}
+		LuaRemove(g_LuaState, -(RetTypeNum.m_num + 1)); // the error handler
+	}
+
+	template <class... T>
+	static void CallRImpl(FLuaReturnTypeNum &&RetTypeNum, const FLuaFunctionRef &Func, T&&... args)
+	{
+		CallFunctionRef(RetTypeNum.m_num, Func, Forward<T>(args)...);
+	}
+
+	template <class... T>
+	static void CallRImpl(FLuaReturnTypeNum &&RetTypeNum, FLuaFunctionRef &Func, T&&... args)
+	{
+		CallFunctionRef(RetTypeNum.m_num, Func, Forward<T>(args)...);
+	}
+
+	template <class... T>
+	static void CallFunctionRef(int32 RetNum, const FLuaFunctionRef &Func, T&&... args)
+	{ // leaves exactly RetNum values on the stack, nils on errors
+		if (!Func.Push(g_LuaState))
+		{
+			TemplateLogError(TEXT("call an invalid lua function ref!!!"));
+			PushNils(g_LuaState, RetNum);
+			return;
+		}
+
+		int32 paramCount = Push(g_LuaState, Forward<T>(args)...);
+		if (LuaPCall(g_LuaState, paramCount, RetNum, -(paramCount + 2)))
+		{
+			FString log = FString::Printf(TEXT("call function ref found an error: %s!!!"), ANSI_TO_TCHAR(LuaToString(g_LuaState, -1)));
+			TemplateLogError(log);
+			LuaPop(g_LuaState, 2);
+			PushNils(g_LuaState, RetNum);
+			return;
 		}
+		LuaRemove(g_LuaState, -(RetNum + 1)); // the error handler
 	}
 
 	template <class T1, class... T>
@@ -107,6 +346,17 @@ public:
 		return pCppObj;
 	}
 
+	template <class T>
+	static T TouserSelf(lua_State *InLuaState, const char *ClassName)
+	{ // self of a binding at 1, a nil or released self raises a lua error instead of reaching the binding
+		T pCppObj = TouserData<T>(InLuaState, 1, ClassName);
+		if (pCppObj == nullptr)
+		{
+			luaL_error(InLuaState, "%s: calling a method on a nil or released object", ClassName);
+		}
+		return pCppObj;
+	}
+
 	static void TouserData(lua_State *InLuaState, const int32 LuaStackIndex, uint8   &ReturnValue);
 	static void TouserData(lua_State *InLuaState, const int32 LuaStackIndex, uint16  &ReturnValue);
 	static void TouserData(lua_State *InLuaState, const int32 LuaStackIndex, uint32  &ReturnValue);
@@ -133,6 +383,22 @@ private:
 	template <class T>
 	static void TouserDataInner(lua_State *InLuaState, const int32 LuaStackIndex, FLuaClassType<T> &&OutValue);
 
+	template <class T>
+	static bool IsRelatedClass(lua_State *InLuaState, const FLuaUserData &UserData, const char *ClassName);
+
+	template <class T>
+	static typename TEnableIf<TPointerIsConvertibleFromTo<typename TRemoveCV<typename TRemovePointer<T>::Type>::Type, const UObject>::Value, bool>::Type IsDynamicInstanceOf(void *pObj)
+	{ // the userdata may carry the static type it was pushed with, ask the object itself
+		typedef typename TRemoveCV<typename TRemovePointer<T>::Type>::Type FObjectType;
+		return pObj != nullptr && static_cast<UObject*>(pObj)->IsA(FObjectType::StaticClass());
+	}
+
+	template <class T>
+	static typename TEnableIf<!TPointerIsConvertibleFromTo<typename TRemoveCV<typename TRemovePointer<T>::Type>::Type, const UObject>::Value, bool>::Type IsDynamicInstanceOf(void *pObj)
+	{ // no runtime type for plain structs, a parent userdata is never a T
+		return false;
+	}
+
 public: // push args
 	template <class T1, class... T>
 	static int32 Push(lua_State *InLuaState, T1 &&Value, T&&... args)
@@ -144,6 +410,15 @@ public: // push args
 	template <class T>
 	static int32 Push(lua_State *InLuaState, FLuaClassType<T> &&value);
 
+	template <class T>
+	static int32 Push(lua_State *InLuaState, FLuaValueType<T> &&value);
+
+	template <class T>
+	static int32 Push(lua_State *InLuaState, FLuaOutParam<T> &&value)
+	{
+		return Push(InLuaState, value.m_Value);
+	}
+
 	static int32 Push(lua_State *InLuaState);
 	static int32 Push(lua_State *InLuaState, uint8  value);
 	static int32 Push(lua_State *InLuaState, uint16 value);
@@ -174,28 +449,54 @@ public: // push args
 	static int32 Push(lua_State *InLuaState, FLuaClassType<const FText> &&value);
 
 	static int32 PushNil(lua_State *InLuaState);
+	static int32 PushRootedObject(lua_State *InLuaState, UObject *pObj, const char *ClassName); // keep the object alive until its userdata is collected
+
+public: // batch property access, one C call for many properties through the Get_/Set_ functions of the class
+	static int32 GetMany(lua_State *InLuaState, int32 LuaStackIndex, const char *const PropertyNames[], int32 PropertyNum); // pushes PropertyNum values, nil for unknown names
+	static void SetMany(lua_State *InLuaState, int32 LuaStackIndex, int32 TableIndex); // every name = value of the table
+	static int32 GetManyFunc(lua_State *InLuaState); // obj:GetMany({ "A", "B" } [, OutTable]) returns { A = a, B = b }
+	static int32 SetManyFunc(lua_State *InLuaState); // obj:SetMany({ A = a, B = b })
+
+public: // ownership
+	static void ReleaseUserData(lua_State *InLuaState, int32 LuaStackIndex); // release an owned or rooted object before __gc
+	static void SetOwner(lua_State *InLuaState, int32 LuaStackIndex, int32 OwnerIndex); // the userdata points into the owner, keep the owner alive as long as it
 
 private: // not export Function
-	static void AddClass(lua_State *InLuaState, const char *ClassName);
+	static void AddClass(lua_State *InLuaState, const char *ClassName, int32 ClassId, int32 ClassIdEnd);
 	static void OpenClass(lua_State *InLuaState, const char *ClassName);
 	static void CloseClass(lua_State *InLuaState);
 	static void RegisterClassFunctions( lua_State *InLuaState, const luaL_Reg ClassFunctions[]);
+	static void RegisterPropertyFunctions(lua_State *InLuaState, void *PropertyTableKey, const luaL_Reg PropertyFunctions[]);
 	static void AddClassFunction(lua_State *InLuaState, const char *FuncName, lua_CFunction &luaFunction);
 	static void InitMetaMethods(lua_State *InLuaState); // ʼԪеԪ
-	static void InitUserDefinedFuncs(lua_State *InLuaState, const char *ClassName); // ʼԪеԶ
-	static bool ExistData(lua_State *InLuaState, const FString &UserDataKey);
+	static void InitUserDefinedFuncs(lua_State *InLuaState, const char *ClassName, int32 ClassId, int32 ClassIdEnd); // ʼԪеԶ
+	static void PushNewPropertyTable(lua_State *InLuaState, void *PropertyTableKey); // property name -> getter/setter, upvalue of __index/__newindex
+	static void InitUserDataCache(lua_State *InLuaState); // weak table in metatable caching pushed userdatas by pointer
 	static bool ExistClass(lua_State *InLuaState, const char *ClassName);
+	static FLuaUserData* ToCppUserData(lua_State *InLuaState, int32 LuaStackIndex); // nullptr if the metatable of the userdata is not a registered class
+	static bool ResolveClassId(lua_State *InLuaState, const char *ClassName, int32 &OutClassId, int32 &OutClassIdEnd);
+	static void PushMetaTable(lua_State *InLuaState, const char *ClassName); // luaL_getmetatable, registering a lazy class if needed
 
 public: // log
 	static void TemplateLogPrint(const FString &Content);
 	static void TemplateLogWarning(const FString &Content);
 	static void TemplateLogError(const FString &Content);
 	static void TemplateLogFatal(const FString &Content);
-	static FString AdjustUserdataKey(const FString &InUserdataKey);
 
 private:
 	static void PushObjInner(lua_State *InLuaState, void *pObj, const char *pName);
+	static void* PushValueInner(lua_State *InLuaState, int32 ValueSize, int32 ValueAlign, const char *pName, void (*Destructor)(void*));
+
+	template <class T>
+	static void DestructValue(void *pValue)
+	{
+		static_cast<T*>(pValue)->~T();
+	}
 	static void LuaPop(lua_State *InLuaState, int32 Num);
+	static void LuaRemove(lua_State *InLuaState, int32 LuaStackIndex);
+	static int32 LuaGetTop(lua_State *InLuaState);
+	static void LuaSetTop(lua_State *InLuaState, int32 LuaStackIndex);
+	static void PushNils(lua_State *InLuaState, int32 Num);
 	static void LuaPushErrorFunc(lua_State *InLuaState);
 	static void LuaGetFiled(lua_State *InLuaState, int32 LuaStackIndex, const char*pKey);
 	static const char* LuaToString(lua_State *InLuaState, int32 LuaStackIndex);
@@ -204,22 +505,31 @@ private:
 
 template <class T>
 int32 FLuaUtil::Push(lua_State *InLuaState, FLuaClassType<T> &&value)
-{ // push class args
+{ // push class args, UObjects are referenced while lua holds them
+	typedef typename TRemoveCV<typename TRemovePointer<T>::Type>::Type FClassType;
+	if (TIsDerivedFrom<FClassType, UObject>::IsDerived)
+	{
+		return PushRootedObject(InLuaState, (UObject*)value.m_ClassObj, value.m_ClassName);
+	}
 
 	PushObjInner(InLuaState, (void*)value.m_ClassObj, value.m_ClassName);
 	return 1;
 }
 
 template <class T>
-void FLuaUtil::TouserData(lua_State *InLuaState, const int32 LuaStackIndex, FLuaClassType<T> &&ReturnValue)
-{
-	const char *ClassName = ReturnValue.m_ClassName;
-	if (!ExistClass(InLuaState, ReturnValue.m_ClassName))
+int32 FLuaUtil::Push(lua_State *InLuaState, FLuaValueType<T> &&value)
+{ // construct the value in place, __gc of the class runs its destructor
+	void *pValue = PushValueInner(InLuaState, sizeof(T), alignof(T), value.m_ClassName, &DestructValue<T>);
+	if (pValue)
 	{
-		TemplateLogError(FString::Printf(TEXT("can not Pop class %s, it not export!!!"), ReturnValue.m_ClassName));
-		return;
+		new (pValue) T(MoveTemp(value.m_Value));
 	}
+	return 1;
+}
 
+template <class T>
+void FLuaUtil::TouserData(lua_State *InLuaState, const int32 LuaStackIndex, FLuaClassType<T> &&ReturnValue)
+{
 	TouserDataInner(InLuaState, LuaStackIndex, Forward<FLuaClassType<T>>(ReturnValue));
 }
 
@@ -234,7 +544,21 @@ void FLuaUtil::TouserDataInner(lua_State *InLuaState, const int32 LuaStackIndex,
 	}
 	else if (lua_isuserdata(InLuaState, LuaStackIndex) == 1)
 	{
-		OutValue.m_ClassObj = *(static_cast<T*>(lua_touserdata(InLuaState, LuaStackIndex)));
+		FLuaUserData *pUserData = ToCppUserData(InLuaState, LuaStackIndex);
+		if (pUserData == nullptr)
+		{
+			OutValue.m_ClassObj = nullptr;
+			TemplateLogError(FString::Printf(TEXT("can not Pop class %s, the userdata is not pushed by cpp!!!"), ANSI_TO_TCHAR(OutValue.m_ClassName)));
+		}
+		else if (!IsRelatedClass<T>(InLuaState, *pUserData, OutValue.m_ClassName))
+		{
+			OutValue.m_ClassObj = nullptr;
+			TemplateLogError(FString::Printf(TEXT("can not Pop class %s, the userdata is another class!!!"), ANSI_TO_TCHAR(OutValue.m_ClassName)));
+		}
+		else
+		{
+			OutValue.m_ClassObj = static_cast<T>(pUserData->pObj);
+		}
 	}
 	else if (lua_istable(InLuaState, LuaStackIndex))
 	{
@@ -248,3 +572,29 @@ void FLuaUtil::TouserDataInner(lua_State *InLuaState, const int32 LuaStackIndex,
 		TemplateLogError(TEXT("TouserData error"));
 	}
 }
+
+// the class ids of a subtree are contiguous, so the check is a few comparisons.
+// only T and its children pass by id, a userdata of a parent of T passes only if the object really is a T
+template <class T>
+bool FLuaUtil::IsRelatedClass(lua_State *InLuaState, const FLuaUserData &UserData, const char *ClassName)
+{
+	typedef TLuaClassId<T> FClassId;
+	if (FClassId::ClassIdEnd == 0 && !ResolveClassId(InLuaState, ClassName, FClassId::ClassId, FClassId::ClassIdEnd))
+	{ // no class id for T, nothing to check against
+		return true;
+	}
+
+	if (UserData.ClassIdEnd <= 0)
+	{ // class registered without id
+		return true;
+	}
+
+	if (FClassId::ClassId <= UserData.ClassId && UserData.ClassId < FClassId::ClassIdEnd)
+	{
+		return true;
+	}
+
+	return UserData.ClassId <= FClassId::ClassId && FClassId::ClassId < UserData.ClassIdEnd && IsDynamicInstanceOf<T>(UserData.pObj);
+}
+
+#include "LuaMathOps.h"
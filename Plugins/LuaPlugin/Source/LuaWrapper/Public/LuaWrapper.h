@@ -13,10 +13,10 @@ public:
 
 public:
 	lua_State* GetLuaState() { return g_LuaState; }
+	class FLuaAllocator* GetLuaAllocator() { return g_LuaAllocator; }
 
 private:
 	void InitLuaEnv();
-	void InitGlobalTable();
 	void CloseLuaEnv();
 	void RegisterLuaLog();
 	void RegisterAllClasses();
@@ -6,5 +6,10 @@ DECLARE_LOG_CATEGORY_EXTERN(LogLua, Log, All);
 #define LuaWrapperLog(LogVerbosity, FormatString, ...) UE_LOG(LogLua, LogVerbosity, FormatString, ##__VA_ARGS__ )
 
 LUAWRAPPER_API extern struct lua_State  *g_LuaState;
+LUAWRAPPER_API extern uint32 g_LuaStateGeneration; // bumped by every InitLuaEnv, a new state may reuse the old address
 extern class FLuaWrapper *g_LuaWrapper;
+extern class FLuaObjectReferencer *g_LuaObjectReferencer;
+LUAWRAPPER_API extern class FLuaAllocator *g_LuaAllocator;
+extern class FLuaGCScheduler *g_LuaGCScheduler;
+extern class FLuaProfiler *g_LuaProfiler;
 